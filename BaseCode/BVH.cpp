@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <limits>
+#include "BVH.h"
+#include "FrustumCuller.h"
+
+
+using namespace std;
+
+
+// Centroid bins evaluated per split
+#define SAH_BINS 16
+
+
+static AABB emptyAABB()
+{
+	AABB aabb;
+	aabb.min = glm::vec3(numeric_limits<float>::max());
+	aabb.max = glm::vec3(-numeric_limits<float>::max());
+	return aabb;
+}
+
+static void growAABB(AABB &aabb, const AABB &other)
+{
+	aabb.min = glm::min(aabb.min, other.min);
+	aabb.max = glm::max(aabb.max, other.max);
+}
+
+
+BVH::BVH()
+{
+}
+
+
+void BVH::resize(int newCount)
+{
+	instanceAABBs.resize(newCount);
+	centroids.resize(newCount);
+	nodes.clear();
+	indices.clear();
+}
+
+void BVH::setAABB(int i, const AABB &aabb)
+{
+	instanceAABBs[i] = aabb;
+	centroids[i] = 0.5f * (aabb.min + aabb.max);
+}
+
+void BVH::build()
+{
+	int count = size();
+	indices.resize(count);
+	for(int i=0; i<count; i++)
+		indices[i] = i;
+
+	nodes.resize(max(2 * count - 1, 0));
+	if(count > 0)
+		buildNode(0, 0, count);
+}
+
+void BVH::refit()
+{
+	// Children always come after their parent
+	for(int i=int(nodes.size())-1; i>=0; i--)
+	{
+		Node &node = nodes[i];
+		if(node.count == 1)
+			node.aabb = instanceAABBs[indices[node.first]];
+		else
+		{
+			node.aabb = nodes[i + 1].aabb;
+			growAABB(node.aabb, nodes[node.right].aabb);
+		}
+	}
+}
+
+int BVH::rebuildDegraded(float threshold)
+{
+	if(nodes.empty())
+		return 0;
+
+	int rebuilt = 0;
+	vector<int> stack(1, 0);
+	while(!stack.empty())
+	{
+		int i = stack.back();
+		stack.pop_back();
+
+		Node &node = nodes[i];
+		if(node.count == 1)
+			continue;
+
+		if(surfaceArea(node.aabb) > threshold * node.builtArea)
+		{
+			buildNode(i, node.first, node.count);
+			rebuilt++;
+		}
+		else
+		{
+			stack.push_back(node.right);
+			stack.push_back(i + 1);
+		}
+	}
+	return rebuilt;
+}
+
+void BVH::cull(const Frustum &frustum, vector<int> &visibleInstances)
+{
+	if(!nodes.empty())
+		cullNode(frustum, 0, FrustumCuller::ALL_PLANES, visibleInstances);
+}
+
+// Build the subtree of the instances in [first, first + count) of indices, in
+// the 2 * count - 1 nodes starting at node
+void BVH::buildNode(int node, int first, int count)
+{
+	AABB bounds = emptyAABB(), centroidBounds = emptyAABB();
+	for(int k=first; k<first+count; k++)
+	{
+		growAABB(bounds, instanceAABBs[indices[k]]);
+		centroidBounds.min = glm::min(centroidBounds.min, centroids[indices[k]]);
+		centroidBounds.max = glm::max(centroidBounds.max, centroids[indices[k]]);
+	}
+
+	Node &n = nodes[node];
+	n.aabb = bounds;
+	n.first = first;
+	n.count = count;
+	n.right = -1;
+	n.builtArea = surfaceArea(bounds);
+	n.lastFailingPlane = 0;
+	if(count == 1)
+		return;
+
+	// Split along the axis of largest centroid extent
+	glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+	int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+	int leftCount = count / 2;
+
+	if(extent[axis] > 0.0f)
+	{
+		int binCount[SAH_BINS] = { 0 };
+		AABB binBounds[SAH_BINS];
+		for(int b=0; b<SAH_BINS; b++)
+			binBounds[b] = emptyAABB();
+
+		float scale = SAH_BINS / extent[axis];
+		auto binOf = [&](int instance)
+		{
+			return min(int((centroids[instance][axis] - centroidBounds.min[axis]) * scale), SAH_BINS - 1);
+		};
+		for(int k=first; k<first+count; k++)
+		{
+			int b = binOf(indices[k]);
+			binCount[b]++;
+			growAABB(binBounds[b], instanceAABBs[indices[k]]);
+		}
+
+		// Cost of splitting before bin b: the area of each side times its instances
+		float rightCost[SAH_BINS];
+		AABB rightBounds = emptyAABB();
+		int rightCount = 0;
+		for(int b=SAH_BINS-1; b>0; b--)
+		{
+			growAABB(rightBounds, binBounds[b]);
+			rightCount += binCount[b];
+			rightCost[b] = rightCount * surfaceArea(rightBounds);
+		}
+
+		float bestCost = numeric_limits<float>::max();
+		int bestBin = 0;
+		AABB leftBounds = emptyAABB();
+		int leftInstances = 0;
+		for(int b=1; b<SAH_BINS; b++)
+		{
+			growAABB(leftBounds, binBounds[b - 1]);
+			leftInstances += binCount[b - 1];
+			if(leftInstances == 0 || leftInstances == count)
+				continue;
+
+			float cost = leftInstances * surfaceArea(leftBounds) + rightCost[b];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestBin = b;
+			}
+		}
+
+		// The first and last bins are never empty, so there is always a split
+		int *middle = partition(indices.data() + first, indices.data() + first + count,
+			[&](int instance) { return binOf(instance) < bestBin; });
+		leftCount = int(middle - (indices.data() + first));
+	}
+
+	n.right = node + 2 * leftCount;
+	buildNode(node + 1, first, leftCount);
+	buildNode(node + 2 * leftCount, first + leftCount, count - leftCount);
+}
+
+void BVH::cullNode(const Frustum &frustum, int node, unsigned int planeMask, vector<int> &visibleInstances)
+{
+	Node &n = nodes[node];
+	if(FrustumCuller::classify(frustum, n.aabb, planeMask, n.lastFailingPlane) == FrustumCuller::OUTSIDE)
+		return;
+
+	if(planeMask == 0 || n.count == 1)
+	{
+		visibleInstances.insert(visibleInstances.end(), indices.begin() + n.first, indices.begin() + n.first + n.count);
+		return;
+	}
+
+	cullNode(frustum, node + 1, planeMask, visibleInstances);
+	cullNode(frustum, n.right, planeMask, visibleInstances);
+}
+
+float BVH::surfaceArea(const AABB &aabb)
+{
+	glm::vec3 d = glm::max(aabb.max - aabb.min, glm::vec3(0.0f));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
@@ -0,0 +1,72 @@
+#ifndef _BVH_INCLUDE
+#define _BVH_INCLUDE
+
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "TriangleMesh.h"
+#include "VectorCamera.h"
+
+
+// BVH is a binary bounding volume hierarchy over the AABBs of the instances,
+// built with the surface area heuristic (SAH) over 16 centroid bins per split.
+//
+// Every leaf holds a single instance, so a subtree of n instances always has
+// 2n - 1 nodes. They are stored depth-first: the left child of a node follows
+// it, and its right child follows the whole left subtree. The instances below
+// a node are a contiguous range of the index array.
+//
+// When the instances move, refit updates the bounds without changing the tree.
+// The tree degrades as the bounds grow, so rebuildDegraded rebuilds in place the
+// topmost subtrees whose area grew too much since they were built, which fit
+// in the same nodes since they keep the same instances.
+
+class BVH
+{
+
+public:
+	BVH();
+
+	void resize(int newCount);
+	void setAABB(int i, const AABB &aabb);
+	int size() const { return int(instanceAABBs.size()); }
+
+	// Build the whole tree from the current AABBs
+	void build();
+	// Recompute the node bounds from the current AABBs, bottom-up
+	void refit();
+	// Rebuild the subtrees whose area is larger than threshold times the one they
+	// were built with. Returns the number of rebuilt subtrees.
+	int rebuildDegraded(float threshold = 2.0f);
+
+	// Append the indices of the instances inside the frustum. Nodes fully inside
+	// the frustum append their whole range without testing their children.
+	void cull(const Frustum &frustum, std::vector<int> &visibleInstances);
+
+	int getNumNodes() const { return int(nodes.size()); }
+
+private:
+	struct Node
+	{
+		AABB aabb;
+		int first, count;	// Range of indices below the node
+		int right;			// Right child, the left one being the next node
+		float builtArea;	// Surface area when the subtree was last built
+		int lastFailingPlane;
+	};
+
+	void buildNode(int node, int first, int count);
+	void cullNode(const Frustum &frustum, int node, unsigned int planeMask, std::vector<int> &visibleInstances);
+
+	static float surfaceArea(const AABB &aabb);
+
+private:
+	std::vector<Node> nodes;
+	std::vector<int> indices;
+	std::vector<AABB> instanceAABBs;
+	std::vector<glm::vec3> centroids;
+
+};
+
+
+#endif // _BVH_INCLUDE
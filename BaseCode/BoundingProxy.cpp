@@ -0,0 +1,235 @@
+#include <cmath>
+#include <algorithm>
+#include "BoundingProxy.h"
+
+
+using namespace std;
+
+
+// Number of Jacobi sweeps to diagonalize the covariance matrix
+#define JACOBI_SWEEPS 16
+
+
+BoundingProxy::BoundingProxy()
+{
+	obb.center = obb.halfExtents = glm::vec3(0.0f);
+	obb.axes = glm::mat3(1.0f);
+	obbTighter = false;
+}
+
+
+void BoundingProxy::build(const TriangleMesh &mesh)
+{
+	free();
+
+	const vector<glm::vec3> &meshVertices = mesh.getVertices();
+	if(meshVertices.empty())
+		return;
+
+	AABB aabb;
+	aabb.min = aabb.max = meshVertices[0];
+	for(const glm::vec3 &v : meshVertices)
+	{
+		aabb.min = glm::min(aabb.min, v);
+		aabb.max = glm::max(aabb.max, v);
+	}
+
+	buildOBB(meshVertices, aabb);
+	buildKDOP(meshVertices, aabb);
+}
+
+void BoundingProxy::free()
+{
+	obb.center = obb.halfExtents = glm::vec3(0.0f);
+	obb.axes = glm::mat3(1.0f);
+	obbTighter = false;
+	vertices.clear();
+	triangles.clear();
+}
+
+OBB BoundingProxy::transform(const glm::mat4 &model) const
+{
+	OBB result;
+	result.center = glm::vec3(model * glm::vec4(obb.center, 1.0f));
+	result.axes = glm::mat3(model) * obb.axes;
+	result.halfExtents = obb.halfExtents;
+	return result;
+}
+
+void BoundingProxy::buildOBB(const vector<glm::vec3> &meshVertices, const AABB &aabb)
+{
+	// Covariance of the vertices
+	glm::vec3 mean(0.0f);
+	for(const glm::vec3 &v : meshVertices)
+		mean += v;
+	mean /= float(meshVertices.size());
+
+	glm::mat3 covariance(0.0f);
+	for(const glm::vec3 &v : meshVertices)
+		covariance += glm::outerProduct(v - mean, v - mean);
+	covariance /= float(meshVertices.size());
+
+	// Its eigenvectors, by Jacobi rotations, are the principal axes
+	glm::mat3 axes(1.0f);
+	for(int sweep=0; sweep<JACOBI_SWEEPS; sweep++)
+		for(int p=0; p<2; p++)
+			for(int q=p+1; q<3; q++)
+			{
+				if(fabs(covariance[q][p]) < 1e-12f)
+					continue;
+
+				float theta = (covariance[q][q] - covariance[p][p]) / (2.0f * covariance[q][p]);
+				float t = (theta >= 0.0f ? 1.0f : -1.0f) / (fabs(theta) + sqrt(theta * theta + 1.0f));
+				float c = 1.0f / sqrt(t * t + 1.0f), s = t * c;
+
+				glm::mat3 rotation(1.0f);
+				rotation[p][p] = rotation[q][q] = c;
+				rotation[q][p] = s;
+				rotation[p][q] = -s;
+				covariance = glm::transpose(rotation) * covariance * rotation;
+				axes = axes * rotation;
+			}
+	axes[0] = glm::normalize(axes[0]);
+	axes[1] = glm::normalize(axes[1] - glm::dot(axes[1], axes[0]) * axes[0]);
+	axes[2] = glm::cross(axes[0], axes[1]);
+
+	glm::vec3 boxMin(numeric_limits<float>::max()), boxMax(-numeric_limits<float>::max());
+	for(const glm::vec3 &v : meshVertices)
+	{
+		glm::vec3 local = glm::transpose(axes) * v;
+		boxMin = glm::min(boxMin, local);
+		boxMax = glm::max(boxMax, local);
+	}
+
+	// Keep the AABB when the principal axes do not give a smaller box
+	glm::vec3 obbSize = boxMax - boxMin, aabbSize = aabb.max - aabb.min;
+	if(obbSize.x * obbSize.y * obbSize.z < aabbSize.x * aabbSize.y * aabbSize.z)
+	{
+		obb.axes = axes;
+		obb.center = axes * (0.5f * (boxMin + boxMax));
+		obb.halfExtents = 0.5f * obbSize;
+		obbTighter = true;
+	}
+	else
+	{
+		obb.axes = glm::mat3(1.0f);
+		obb.center = 0.5f * (aabb.min + aabb.max);
+		obb.halfExtents = 0.5f * aabbSize;
+		obbTighter = false;
+	}
+}
+
+void BoundingProxy::buildKDOP(const vector<glm::vec3> &meshVertices, const AABB &aabb)
+{
+	// Faces of the AABB, counterclockwise seen from outside
+	vector<vector<glm::vec3>> faces;
+	for(int axis=0; axis<3; axis++)
+		for(int side=0; side<2; side++)
+		{
+			int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			if(side == 0)
+				swap(u, v);
+
+			glm::vec3 corner = side ? aabb.max : aabb.min;
+			vector<glm::vec3> face(4, corner);
+			face[1][u] = (side ? aabb.min : aabb.max)[u];
+			face[2][u] = face[1][u];
+			face[2][v] = (side ? aabb.min : aabb.max)[v];
+			face[3][v] = face[2][v];
+			faces.push_back(face);
+		}
+
+	// Slabs along the face and corner diagonals, grown slightly so that
+	// rounding in the clipping never cuts into the mesh
+	static const glm::vec3 diagonals[10] =
+	{
+		glm::vec3(1, 1, 0), glm::vec3(1, -1, 0), glm::vec3(1, 0, 1), glm::vec3(1, 0, -1), glm::vec3(0, 1, 1),
+		glm::vec3(0, 1, -1), glm::vec3(1, 1, 1), glm::vec3(1, 1, -1), glm::vec3(1, -1, 1), glm::vec3(-1, 1, 1)
+	};
+	float margin = 1e-4f * glm::length(aabb.max - aabb.min);
+	for(const glm::vec3 &diagonal : diagonals)
+	{
+		glm::vec3 normal = glm::normalize(diagonal);
+		float dMin = numeric_limits<float>::max(), dMax = -numeric_limits<float>::max();
+		for(const glm::vec3 &v : meshVertices)
+		{
+			dMin = min(dMin, glm::dot(normal, v));
+			dMax = max(dMax, glm::dot(normal, v));
+		}
+		clip(faces, normal, dMax + margin);
+		clip(faces, -normal, -dMin + margin);
+	}
+
+	// Triangle fans of the faces
+	for(const vector<glm::vec3> &face : faces)
+	{
+		int first = int(vertices.size());
+		vertices.insert(vertices.end(), face.begin(), face.end());
+		for(unsigned int k=2; k<face.size(); k++)
+		{
+			triangles.push_back(first);
+			triangles.push_back(first + k - 1);
+			triangles.push_back(first + k);
+		}
+	}
+}
+
+void BoundingProxy::clip(vector<vector<glm::vec3>> &faces, const glm::vec3 &normal, float distance) const
+{
+	const float epsilon = 1e-6f;
+	vector<vector<glm::vec3>> clipped;
+	vector<glm::vec3> capPoints;
+
+	// Sutherland-Hodgman on every face, collecting the points on the plane
+	for(const vector<glm::vec3> &face : faces)
+	{
+		vector<glm::vec3> output;
+		for(unsigned int k=0; k<face.size(); k++)
+		{
+			const glm::vec3 &a = face[k], &b = face[(k + 1) % face.size()];
+			float da = glm::dot(normal, a) - distance, db = glm::dot(normal, b) - distance;
+			if(da <= epsilon)
+			{
+				output.push_back(a);
+				if(da >= -epsilon)
+					capPoints.push_back(a);
+			}
+			if((da < -epsilon && db > epsilon) || (da > epsilon && db < -epsilon))
+			{
+				glm::vec3 p = a + (da / (da - db)) * (b - a);
+				output.push_back(p);
+				capPoints.push_back(p);
+			}
+		}
+		if(output.size() >= 3)
+			clipped.push_back(output);
+	}
+
+	// The points of the cap, each once, sorted counterclockwise around the normal
+	vector<glm::vec3> cap;
+	for(const glm::vec3 &p : capPoints)
+	{
+		bool found = false;
+		for(const glm::vec3 &q : cap)
+			found = found || glm::length(p - q) < 1e-5f;
+		if(!found)
+			cap.push_back(p);
+	}
+
+	if(cap.size() >= 3)
+	{
+		glm::vec3 center(0.0f);
+		for(const glm::vec3 &p : cap)
+			center += p;
+		center /= float(cap.size());
+
+		glm::vec3 u = glm::normalize(cap[0] - center), v = glm::cross(normal, u);
+		sort(cap.begin(), cap.end(), [&](const glm::vec3 &p, const glm::vec3 &q)
+		{
+			return atan2(glm::dot(p - center, v), glm::dot(p - center, u)) < atan2(glm::dot(q - center, v), glm::dot(q - center, u));
+		});
+		clipped.push_back(cap);
+	}
+
+	faces.swap(clipped);
+}
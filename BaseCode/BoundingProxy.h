@@ -0,0 +1,67 @@
+#ifndef _BOUNDING_PROXY_INCLUDE
+#define _BOUNDING_PROXY_INCLUDE
+
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "TriangleMesh.h"
+
+
+// Oriented bounding box: a center, three orthonormal axes (the columns of
+// axes) and the half extent of the box along each of them
+struct OBB
+{
+	glm::vec3 center;
+	glm::mat3 axes;
+	glm::vec3 halfExtents;
+};
+
+
+// BoundingProxy holds bounding volumes of a TriangleMesh that are tighter than
+// its AABB. They must be outer-conservative: the whole mesh lies inside them.
+//
+// The OBB is fit along the principal axes of the vertices, and falls back to
+// the AABB when that is smaller. Instances get their OBB by transforming this
+// one with their model matrix, so it follows their rotation.
+//
+// The proxy mesh is the 26-DOP of the mesh: the intersection of the slabs
+// bounding the vertices along the 3 axes, the 6 face diagonals and the 4
+// corner diagonals. It is built by clipping the AABB by the diagonal planes,
+// and rendered instead of the AABB cube in the occlusion queries.
+
+class BoundingProxy
+{
+
+public:
+	BoundingProxy();
+
+	void build(const TriangleMesh &mesh);
+	void free();
+
+	// OBB of the mesh, in its own space
+	const OBB& getOBB() const { return obb; }
+	// Whether the OBB is smaller than the AABB, instead of the AABB itself
+	bool isOBBTighter() const { return obbTighter; }
+	// OBB of an instance placed with a rotation and translation model matrix
+	OBB transform(const glm::mat4 &model) const;
+
+	const vector<glm::vec3>& getVertices() const { return vertices; }
+	const vector<int>& getTriangles() const { return triangles; }
+	int getNumTriangles() const { return int(triangles.size() / 3); }
+
+private:
+	void buildOBB(const vector<glm::vec3> &meshVertices, const AABB &aabb);
+	void buildKDOP(const vector<glm::vec3> &meshVertices, const AABB &aabb);
+	// Keep the part of the polytope with dot(normal, x) <= distance
+	void clip(vector<vector<glm::vec3>> &faces, const glm::vec3 &normal, float distance) const;
+
+private:
+	OBB obb;
+	bool obbTighter;
+	vector<glm::vec3> vertices;
+	vector<int> triangles;
+
+};
+
+
+#endif // _BOUNDING_PROXY_INCLUDE
@@ -0,0 +1,73 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "DepthSorter.h"
+
+
+using namespace std;
+
+
+// Bits of the quantized depth
+#define DEPTH_BITS 16
+
+
+DepthSorter::DepthSorter()
+{
+	valid = false;
+	sortedEye = sortedForward = glm::vec3(0.0f);
+	setReuseThresholds(0.1f, 2.0f);
+}
+
+
+bool DepthSorter::sort(vector<int> &instances, const float *positions, const glm::mat4 &view, JobSystem *jobSystem)
+{
+	// Camera position and direction, from the view matrix
+	glm::mat3 rotation(view);
+	glm::vec3 eye = -(glm::transpose(rotation) * glm::vec3(view[3]));
+	glm::vec3 forward = -glm::vec3(view[0][2], view[1][2], view[2][2]);
+
+	if(valid && instances == sortedInput && glm::length(eye - sortedEye) < reuseDistance &&
+		glm::dot(forward, sortedForward) > reuseCosine)
+	{
+		instances = sortedOutput;
+		return false;
+	}
+
+	valid = true;
+	sortedEye = eye;
+	sortedForward = forward;
+	sortedInput = instances;
+
+	int count = int(instances.size());
+	keys.resize(count);
+	order = instances;
+	if(count > 1)
+	{
+		// View depth of every instance, and its range
+		depths.resize(count);
+		float minDepth = numeric_limits<float>::max(), maxDepth = -numeric_limits<float>::max();
+		for(int k=0; k<count; k++)
+		{
+			int i = instances[k];
+			depths[k] = glm::dot(forward, glm::vec3(positions[i*3], positions[i*3+1], positions[i*3+2]) - eye);
+			minDepth = min(minDepth, depths[k]);
+			maxDepth = max(maxDepth, depths[k]);
+		}
+
+		float scale = float((1 << DEPTH_BITS) - 1) / max(maxDepth - minDepth, 1e-6f);
+		for(int k=0; k<count; k++)
+			keys[k] = (unsigned int)((depths[k] - minDepth) * scale);
+
+		radixSort.sort(keys, order, DEPTH_BITS, jobSystem);
+	}
+
+	instances = order;
+	sortedOutput = order;
+	return true;
+}
+
+void DepthSorter::setReuseThresholds(float distance, float degrees)
+{
+	reuseDistance = distance;
+	reuseCosine = cos(glm::radians(degrees));
+}
@@ -0,0 +1,48 @@
+#ifndef _DEPTH_SORTER_INCLUDE
+#define _DEPTH_SORTER_INCLUDE
+
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "JobSystem.h"
+#include "RadixSort.h"
+
+
+// DepthSorter orders a set of instances front to back, so that the nearest ones
+// fill the depth buffer first. The view depth of every instance position is
+// quantized to 16 bits over the depth range of the set, and the keys are sorted
+// with a parallel LSD radix sort of two 8-bit digits. Instances closer in depth
+// than the quantization step may swap, which does not matter for early-Z.
+//
+// While the camera moves or turns less than the reuse thresholds and the set is
+// the same, the order of the last sort is returned as is. invalidate() forces
+// the next call to sort, when the instances themselves move.
+
+class DepthSorter
+{
+
+public:
+	DepthSorter();
+
+	// Reorder instances nearest first. Returns false when the last order was reused.
+	bool sort(std::vector<int> &instances, const float *positions, const glm::mat4 &view, JobSystem *jobSystem);
+	void invalidate() { valid = false; }
+
+	void setReuseThresholds(float distance, float degrees);
+
+private:
+	bool valid;
+	float reuseDistance, reuseCosine;
+	glm::vec3 sortedEye, sortedForward;
+	std::vector<int> sortedInput, sortedOutput;
+
+	// Quantized depths, sorted with the order of the instances
+	std::vector<float> depths;
+	std::vector<unsigned int> keys;
+	std::vector<int> order;
+	RadixSort<int> radixSort;
+
+};
+
+
+#endif // _DEPTH_SORTER_INCLUDE
@@ -0,0 +1,216 @@
+#include <cmath>
+#include <algorithm>
+#include "FrustumCuller.h"
+#include "FrustumCullerAVX.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE
+#include <emmintrin.h>
+#endif
+
+
+using namespace std;
+
+
+// AABBs tested per iteration without AVX, and the bits of a mask word
+#if defined(FRUSTUM_CULLER_SSE)
+#define BATCH_SIZE 4
+#else
+#define BATCH_SIZE 1
+#endif
+#define MASK_BITS 32
+
+
+FrustumCuller::FrustumCuller()
+{
+	count = 0;
+}
+
+
+void FrustumCuller::resize(int newCount)
+{
+	count = newCount;
+	int padded = (count + MASK_BITS - 1) / MASK_BITS * MASK_BITS;
+	minX.resize(padded, 0.0f);
+	minY.resize(padded, 0.0f);
+	minZ.resize(padded, 0.0f);
+	maxX.resize(padded, 0.0f);
+	maxY.resize(padded, 0.0f);
+	maxZ.resize(padded, 0.0f);
+}
+
+void FrustumCuller::setAABB(int i, const AABB &aabb)
+{
+	minX[i] = aabb.min.x;
+	minY[i] = aabb.min.y;
+	minZ[i] = aabb.min.z;
+	maxX[i] = aabb.max.x;
+	maxY[i] = aabb.max.y;
+	maxZ[i] = aabb.max.z;
+}
+
+AABB FrustumCuller::getAABB(int i) const
+{
+	AABB aabb;
+	aabb.min = glm::vec3(minX[i], minY[i], minZ[i]);
+	aabb.max = glm::vec3(maxX[i], maxY[i], maxZ[i]);
+	return aabb;
+}
+
+void FrustumCuller::cull(const Frustum &frustum, vector<unsigned int> &visibleMask) const
+{
+	visibleMask.resize((count + MASK_BITS - 1) / MASK_BITS);
+	cull(frustum, visibleMask, 0, count);
+}
+
+void FrustumCuller::cull(const Frustum &frustum, vector<unsigned int> &visibleMask, int begin, int end) const
+{
+	end = min(end, count);
+	fill(visibleMask.begin() + begin / MASK_BITS, visibleMask.begin() + (end + MASK_BITS - 1) / MASK_BITS, 0u);
+	cullBatches(frustum, begin, end, [&visibleMask](int first, unsigned int bits)
+	{
+		// Batches never straddle two words: with AVX they are whole words, and
+		// otherwise BATCH_SIZE divides MASK_BITS
+		visibleMask[first / MASK_BITS] |= bits << (first % MASK_BITS);
+	});
+}
+
+void FrustumCuller::cull(const Frustum &frustum, vector<int> &visibleIndices) const
+{
+	visibleIndices.clear();
+	cullBatches(frustum, 0, count, [&visibleIndices](int first, unsigned int bits)
+	{
+		for(int b=0; bits != 0; b++, bits >>= 1)
+			if(bits & 1)
+				visibleIndices.push_back(first + b);
+	});
+}
+
+bool FrustumCuller::isInside(const Frustum &frustum, const AABB &aabb)
+{
+	for(const glm::vec4 &plane : frustum.planes)
+	{
+		glm::vec3 closestPoint;
+		closestPoint.x = (plane.x >= 0.0f) ? aabb.min.x : aabb.max.x;
+		closestPoint.y = (plane.y >= 0.0f) ? aabb.min.y : aabb.max.y;
+		closestPoint.z = (plane.z >= 0.0f) ? aabb.min.z : aabb.max.z;
+
+		if(glm::dot(closestPoint, glm::vec3(plane)) + plane.w >= 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool FrustumCuller::isInside(const Frustum &frustum, const OBB &obb)
+{
+	for(const glm::vec4 &plane : frustum.planes)
+	{
+		glm::vec3 normal(plane);
+		float radius = obb.halfExtents.x * fabs(glm::dot(normal, obb.axes[0])) +
+			obb.halfExtents.y * fabs(glm::dot(normal, obb.axes[1])) +
+			obb.halfExtents.z * fabs(glm::dot(normal, obb.axes[2]));
+
+		if(glm::dot(obb.center, normal) + plane.w - radius >= 0.0f)
+			return false;
+	}
+	return true;
+}
+
+FrustumCuller::Classification FrustumCuller::classify(const Frustum &frustum, const AABB &aabb, unsigned int &planeMask, int &lastPlane)
+{
+	for(int i=0; i<6 && planeMask != 0; i++)
+	{
+		// The last failing plane first, then the others in order
+		int p = (i == 0) ? lastPlane : (i <= lastPlane ? i - 1 : i);
+		if(!(planeMask & (1u << p)))
+			continue;
+
+		const glm::vec4 &plane = frustum.planes[p];
+		glm::vec3 normal(plane);
+		glm::vec3 nVertex, pVertex;
+		nVertex.x = (plane.x >= 0.0f) ? aabb.min.x : aabb.max.x;
+		nVertex.y = (plane.y >= 0.0f) ? aabb.min.y : aabb.max.y;
+		nVertex.z = (plane.z >= 0.0f) ? aabb.min.z : aabb.max.z;
+		pVertex.x = (plane.x >= 0.0f) ? aabb.max.x : aabb.min.x;
+		pVertex.y = (plane.y >= 0.0f) ? aabb.max.y : aabb.min.y;
+		pVertex.z = (plane.z >= 0.0f) ? aabb.max.z : aabb.min.z;
+
+		if(glm::dot(nVertex, normal) + plane.w >= 0.0f)
+		{
+			lastPlane = p;
+			return OUTSIDE;
+		}
+		if(glm::dot(pVertex, normal) + plane.w < 0.0f)
+			planeMask &= ~(1u << p);
+	}
+
+	return planeMask == 0 ? INSIDE : INTERSECTING;
+}
+
+template<class Output>
+void FrustumCuller::cullBatches(const Frustum &frustum, int begin, int end, Output output) const
+{
+	// The n-vertex coordinates of each plane
+	const float *cornerX[6], *cornerY[6], *cornerZ[6];
+	for(int p=0; p<6; p++)
+	{
+		const glm::vec4 &plane = frustum.planes[p];
+		cornerX[p] = (plane.x >= 0.0f) ? minX.data() : maxX.data();
+		cornerY[p] = (plane.y >= 0.0f) ? minY.data() : maxY.data();
+		cornerZ[p] = (plane.z >= 0.0f) ? minZ.data() : maxZ.data();
+	}
+
+#if defined(FRUSTUM_CULLER_AVX)
+	// With AVX, a whole mask word of AABBs is tested per call of the kernel
+	static const bool avx = hasAVX();
+	if(avx)
+	{
+		for(int first=begin; first<end; first+=MASK_BITS)
+		{
+			unsigned int bits = ~frustumOutsideAVX(cornerX, cornerY, cornerZ, &frustum.planes[0].x, first);
+			if(end - first < MASK_BITS)
+				bits &= (1u << (end - first)) - 1u;
+			if(bits != 0)
+				output(first, bits);
+		}
+		return;
+	}
+#endif
+
+	// Bits of the last batch past end are dropped
+	const unsigned int batchBits = (1u << BATCH_SIZE) - 1u;
+
+	for(int first=begin; first<end; first+=BATCH_SIZE)
+	{
+		unsigned int outside;
+
+#if defined(FRUSTUM_CULLER_SSE)
+		__m128 outsideMask = _mm_setzero_ps();
+		for(int p=0; p<6; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(cornerX[p] + first)),
+					_mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(cornerY[p] + first))),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(cornerZ[p] + first)),
+					_mm_set1_ps(plane.w)));
+			outsideMask = _mm_or_ps(outsideMask, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+		}
+		outside = unsigned(_mm_movemask_ps(outsideMask));
+#else
+		outside = 0u;
+		for(int p=0; p<6; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			if(plane.x * cornerX[p][first] + plane.y * cornerY[p][first] + plane.z * cornerZ[p][first] + plane.w >= 0.0f)
+				outside = 1u;
+		}
+#endif
+
+		unsigned int bits = ~outside & batchBits;
+		if(end - first < BATCH_SIZE)
+			bits &= (1u << (end - first)) - 1u;
+		if(bits != 0)
+			output(first, bits);
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef _FRUSTUM_CULLER_INCLUDE
+#define _FRUSTUM_CULLER_INCLUDE
+
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "TriangleMesh.h"
+#include "BoundingProxy.h"
+#include "VectorCamera.h"
+
+
+// FrustumCuller stores a set of AABBs as a structure of arrays (one array per
+// coordinate of min and max), and tests them against the frustum in batches:
+// 8 boxes per iteration with AVX, 4 with SSE2, or one at a time otherwise. The
+// AVX kernel is chosen at runtime, when the CPU supports it.
+//
+// Frustum planes point outwards. For each plane, only the corner of the box
+// farthest inside it (the n-vertex) is tested, and its choice depends only on
+// the signs of the plane normal, so it is the same for the whole batch.
+
+class FrustumCuller
+{
+
+public:
+	FrustumCuller();
+
+	void resize(int newCount);
+	void setAABB(int i, const AABB &aabb);
+	AABB getAABB(int i) const;
+	int size() const { return count; }
+
+	// Bit i % 32 of visibleMask[i / 32] is set when AABB i is inside the frustum
+	void cull(const Frustum &frustum, vector<unsigned int> &visibleMask) const;
+	// Only the words of visibleMask covering [begin, end), begin being a multiple of 32.
+	// Ranges of different words can be culled in parallel.
+	void cull(const Frustum &frustum, vector<unsigned int> &visibleMask, int begin, int end) const;
+	// Indices of the AABBs inside the frustum, in increasing order
+	void cull(const Frustum &frustum, vector<int> &visibleIndices) const;
+
+	static bool isInside(const Frustum &frustum, const AABB &aabb);
+	// The projection of the box on the plane normal is its radius along the normal
+	static bool isInside(const Frustum &frustum, const OBB &obb);
+
+	// Hierarchical culling: only the planes set in planeMask are tested, starting with
+	// lastPlane, the one that culled the box the last time. The planes the box is fully
+	// inside are removed from planeMask, so that its children can skip them.
+	enum Classification
+	{
+		OUTSIDE,
+		INTERSECTING,
+		INSIDE
+	};
+	static const unsigned int ALL_PLANES = 0x3f;
+	static Classification classify(const Frustum &frustum, const AABB &aabb, unsigned int &planeMask, int &lastPlane);
+
+private:
+	// Call output(first, bits) for every batch in [begin, end), bit b meaning AABB first + b is inside
+	template<class Output>
+	void cullBatches(const Frustum &frustum, int begin, int end, Output output) const;
+
+private:
+	int count;
+	// Padded to a whole number of mask words
+	vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+};
+
+
+#endif // _FRUSTUM_CULLER_INCLUDE
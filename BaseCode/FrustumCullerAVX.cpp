@@ -0,0 +1,36 @@
+#include "FrustumCullerAVX.h"
+
+#if defined(FRUSTUM_CULLER_AVX)
+#include <immintrin.h>
+
+
+bool hasAVX()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+}
+
+__attribute__((target("avx")))
+unsigned int frustumOutsideAVX(const float *const cornerX[6], const float *const cornerY[6],
+	const float *const cornerZ[6], const float *planes, int first)
+{
+	unsigned int outside = 0u;
+	for(int batch=0; batch<32; batch+=8)
+	{
+		__m256 outsideMask = _mm256_setzero_ps();
+		for(int p=0; p<6; p++)
+		{
+			const float *plane = planes + 4 * p;
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), _mm256_loadu_ps(cornerX[p] + first + batch)),
+					_mm256_mul_ps(_mm256_set1_ps(plane[1]), _mm256_loadu_ps(cornerY[p] + first + batch))),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[2]), _mm256_loadu_ps(cornerZ[p] + first + batch)),
+					_mm256_set1_ps(plane[3])));
+			outsideMask = _mm256_or_ps(outsideMask, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		outside |= unsigned(_mm256_movemask_ps(outsideMask)) << batch;
+	}
+	return outside;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _FRUSTUM_CULLER_AVX_INCLUDE
+#define _FRUSTUM_CULLER_AVX_INCLUDE
+
+
+// AVX kernel of the FrustumCuller. It lives in a file of its own, and only its
+// functions are compiled for AVX, so that no inline function shared with the
+// rest of the program is ever compiled with AVX instructions. The kernel must
+// only be called when hasAVX() is true.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define FRUSTUM_CULLER_AVX
+
+// Whether the CPU running the program supports AVX
+bool hasAVX();
+
+// Test the 32 AABBs starting at first, 8 at a time, against the 6 planes (4 floats
+// each). cornerX[p], cornerY[p] and cornerZ[p] are the coordinates of the n-vertex
+// of plane p. Bit b of the result is set when AABB first + b is outside.
+unsigned int frustumOutsideAVX(const float *const cornerX[6], const float *const cornerY[6],
+	const float *const cornerZ[6], const float *planes, int first);
+
+#endif
+
+
+#endif // _FRUSTUM_CULLER_AVX_INCLUDE
@@ -0,0 +1,105 @@
+#include "GLState.h"
+
+
+using namespace std;
+
+
+GLint GLState::program = -1;
+GLint GLState::vao = -1;
+GLint GLState::polygon = -1;
+GLint GLState::colorWrite = -1;
+GLint GLState::depthWrite = -1;
+unordered_map<GLuint, unsigned int> GLState::enabledArrays;
+int GLState::issuedCalls = 0;
+int GLState::avoidedCalls = 0;
+
+
+bool GLState::change(GLint &cached, GLint value)
+{
+	if(cached == value)
+	{
+		avoidedCalls++;
+		return false;
+	}
+	cached = value;
+	issuedCalls++;
+	return true;
+}
+
+void GLState::useProgram(GLuint newProgram)
+{
+	if(change(program, GLint(newProgram)))
+		glUseProgram(newProgram);
+}
+
+void GLState::bindVertexArray(GLuint newVao)
+{
+	if(change(vao, GLint(newVao)))
+		glBindVertexArray(newVao);
+}
+
+void GLState::enableVertexAttribArray(GLuint index)
+{
+	// Without a known VAO there is nothing to compare with
+	if(vao < 0 || index >= 32)
+	{
+		issuedCalls++;
+		glEnableVertexAttribArray(index);
+		return;
+	}
+
+	unsigned int &enabled = enabledArrays[GLuint(vao)];
+	if(enabled & (1u << index))
+	{
+		avoidedCalls++;
+		return;
+	}
+	enabled |= 1u << index;
+	issuedCalls++;
+	glEnableVertexAttribArray(index);
+}
+
+void GLState::polygonMode(GLenum mode)
+{
+	if(change(polygon, GLint(mode)))
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GLState::colorMask(bool write)
+{
+	if(change(colorWrite, write ? 1 : 0))
+		glColorMask(write, write, write, write);
+}
+
+void GLState::depthMask(bool write)
+{
+	if(change(depthWrite, write ? 1 : 0))
+		glDepthMask(write);
+}
+
+void GLState::deleteProgram(GLuint deleted)
+{
+	glDeleteProgram(deleted);
+	// A deleted program stays in use until another one is
+	if(program == GLint(deleted))
+		program = -1;
+}
+
+void GLState::deleteVertexArray(GLuint deleted)
+{
+	glDeleteVertexArrays(1, &deleted);
+	enabledArrays.erase(deleted);
+	// Deleting the bound VAO binds 0
+	if(vao == GLint(deleted))
+		vao = 0;
+}
+
+void GLState::invalidate()
+{
+	program = vao = polygon = colorWrite = depthWrite = -1;
+}
+
+void GLState::resetCounters()
+{
+	issuedCalls = avoidedCalls = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef _GL_STATE_INCLUDE
+#define _GL_STATE_INCLUDE
+
+
+#include <unordered_map>
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+
+// GLState caches the OpenGL state that the rendering loops change the most:
+// the bound program and VAO, the polygon mode, the color and depth write masks,
+// and the vertex attribute arrays enabled in each VAO. A call that would set
+// the state to the value it already has is not sent to the driver.
+//
+// Every change of this state must go through GLState, or the cache gets out of
+// date. Code that does not, like the ImGui renderer, must be followed by a call
+// to invalidate(), after which the next call of each kind is always issued.
+//
+// There is a single OpenGL context, so the cache is static. It counts the calls
+// issued and avoided since the last resetCounters().
+
+class GLState
+{
+
+public:
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vao);
+	// Enable an attribute array of the bound VAO
+	static void enableVertexAttribArray(GLuint index);
+	static void polygonMode(GLenum mode);
+	// Write mask of the 4 color channels at once
+	static void colorMask(bool write);
+	static void depthMask(bool write);
+
+	// Delete a program or VAO, and forget its state: its name may be reused
+	static void deleteProgram(GLuint program);
+	static void deleteVertexArray(GLuint vao);
+
+	static void invalidate();
+
+	static void resetCounters();
+	static int getIssuedCalls() { return issuedCalls; }
+	static int getAvoidedCalls() { return avoidedCalls; }
+
+private:
+	// Returns true if the call must be issued, and caches the new value
+	static bool change(GLint &cached, GLint value);
+
+private:
+	// -1 when unknown
+	static GLint program, vao, polygon, colorWrite, depthWrite;
+	// Enabled attribute arrays of each VAO, one bit per index
+	static std::unordered_map<GLuint, unsigned int> enabledArrays;
+	static int issuedCalls, avoidedCalls;
+
+};
+
+
+#endif // _GL_STATE_INCLUDE
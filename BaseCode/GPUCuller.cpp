@@ -0,0 +1,277 @@
+#include <iostream>
+#include <vector>
+#include "GPUCuller.h"
+#include "GLState.h"
+
+
+using namespace std;
+
+
+// Frames the statistics queries stay in flight before being read
+#define STATISTICS_LATENCY 3
+// Draw commands: the frustum culled or previously visible instances, and the disoccluded ones
+#define DRAW_COMMANDS 2
+// Must match local_size_x in cull.comp
+#define CULL_GROUP_SIZE 64
+
+
+// Instance layout shared with the shaders (std430 and vertex attributes)
+struct GPUInstance
+{
+	glm::vec4 position;
+	glm::vec4 color;
+};
+
+// Layout of a glDrawArraysIndirect command
+struct DrawArraysIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint first;
+	GLuint baseInstance;
+};
+
+
+GPUCuller::GPUCuller()
+{
+	instanceBuffer = visibleBuffer = commandBuffer = visibilityBuffer = vao = 0;
+	nInstances = nVertices = 0;
+	ready = false;
+	visibleInstances = 0;
+}
+
+GPUCuller::~GPUCuller()
+{
+	free();
+}
+
+
+bool GPUCuller::init(const TriangleMesh &mesh, const float *positions, const float *colors, int count)
+{
+	free();
+
+	if(!initShaders())
+		return false;
+
+	nInstances = count;
+	nVertices = mesh.getNumVertices();
+	meshAABB = mesh.getAABB();
+
+	// All instances, and the compacted visible ones
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(GPUInstance), NULL, GL_DYNAMIC_DRAW);
+	update(positions, colors);
+	glGenBuffers(1, &visibleBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(GPUInstance), NULL, GL_DYNAMIC_COPY);
+
+	// Indirect draw commands, whose instance counts are written by the compute shader
+	glGenBuffers(1, &commandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, DRAW_COMMANDS * sizeof(DrawArraysIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	// Occlusion culling visibility, starting with every instance hidden
+	vector<GLuint> visibility(count, 0);
+	glGenBuffers(1, &visibilityBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(GLuint), visibility.data(), GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The VAO reads the mesh vertices per vertex, and the visible instances per instance
+	glGenVertexArrays(1, &vao);
+	GLState::bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.getVBO());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), 0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (void *)(3*sizeof(float)));
+	GLState::enableVertexAttribArray(0);
+	GLState::enableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(GPUInstance), 0);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(GPUInstance), (void *)sizeof(glm::vec4));
+	glVertexAttribDivisor(2, 1);
+	glVertexAttribDivisor(3, 1);
+	GLState::enableVertexAttribArray(2);
+	GLState::enableVertexAttribArray(3);
+	GLState::bindVertexArray(0);
+
+	statisticsQueries = QueryPool(DRAW_COMMANDS, STATISTICS_LATENCY + 1, GL_PRIMITIVES_GENERATED);
+
+	ready = true;
+	return true;
+}
+
+void GPUCuller::free()
+{
+	if(instanceBuffer != 0)
+		glDeleteBuffers(1, &instanceBuffer);
+	if(visibleBuffer != 0)
+		glDeleteBuffers(1, &visibleBuffer);
+	if(commandBuffer != 0)
+		glDeleteBuffers(1, &commandBuffer);
+	if(visibilityBuffer != 0)
+		glDeleteBuffers(1, &visibilityBuffer);
+	if(vao != 0)
+		GLState::deleteVertexArray(vao);
+	instanceBuffer = visibleBuffer = commandBuffer = visibilityBuffer = vao = 0;
+	cullProgram.free();
+	renderProgram.free();
+	ready = false;
+}
+
+// Upload the positions and colors of all the instances
+void GPUCuller::update(const float *positions, const float *colors)
+{
+	vector<GPUInstance> instances(nInstances);
+	for(int i=0; i<nInstances; i++)
+	{
+		instances[i].position = glm::vec4(positions[3*i], positions[3*i+1], positions[3*i+2], 1.0f);
+		instances[i].color = glm::vec4(colors[3*i], colors[3*i+1], colors[3*i+2], 1.0f);
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, nInstances * sizeof(GPUInstance), instances.data());
+}
+
+// Count the instances rendered a few frames ago, if their statistics are ready
+void GPUCuller::beginFrame()
+{
+	statisticsQueries.nextFrame();
+
+	int primitives = 0;
+	for(int command=0; command<DRAW_COMMANDS; command++)
+	{
+		if(!statisticsQueries.wasIssued(command, STATISTICS_LATENCY))
+			continue;
+		Query previousStatistics = statisticsQueries.getQuery(command, STATISTICS_LATENCY);
+		if(!previousStatistics.resultIsReady())
+			return;
+		primitives += previousStatistics.result();
+	}
+	visibleInstances = primitives / (nVertices / 3);
+}
+
+// Compact the instances that pass the culling phase into a draw command
+void GPUCuller::cull(const Frustum &frustum, bool frustumCulling, CullPhase phase,
+	const HiZBuffer *hiZ, const glm::mat4 &viewProjection)
+{
+	// Every phase but OCCLUSION starts a new frame of draw commands
+	if(phase != OCCLUSION)
+	{
+		DrawArraysIndirectCommand commands[DRAW_COMMANDS];
+		for(int command=0; command<DRAW_COMMANDS; command++)
+			commands[command] = { GLuint(nVertices), 0, 0, 0 };
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(commands), commands);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	cullProgram.use();
+	cullProgram.setUniform(phaseUniform, int(phase));
+	cullProgram.setUniform(numInstancesUniform, nInstances);
+	cullProgram.setUniform(frustumCullingUniform, int(frustumCulling));
+	cullProgram.setUniform(aabbMinUniform, meshAABB.min);
+	cullProgram.setUniform(aabbMaxUniform, meshAABB.max);
+	for(int p=0; p<6; p++)
+		cullProgram.setUniform(planeUniforms[p], frustum.planes[p]);
+
+	if(hiZ != NULL)
+	{
+		cullProgram.setUniform(viewProjectionUniform, viewProjection);
+		cullProgram.setUniform(hiZLevelsUniform, hiZ->getLevels());
+		cullProgram.setUniform(hiZUniform, 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, hiZ->getTexture());
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, visibilityBuffer);
+	glDispatchCompute((nInstances + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// The draws read the commands and the visible instances written above,
+	// and the next phase reads the instance count of the first command
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	if(hiZ != NULL)
+		glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Render the visible instances of a draw command with a single indirect draw
+void GPUCuller::render(const glm::mat4 &projection, const glm::mat4 &view, int command)
+{
+	renderProgram.use();
+	renderProgram.setUniform(projectionUniform, projection);
+	renderProgram.setUniform(viewUniform, view);
+
+	Query statistics = statisticsQueries.getQuery(command);
+	statistics.begin();
+	GLState::bindVertexArray(vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glDrawArraysIndirect(GL_TRIANGLES, (void *)(command * sizeof(DrawArraysIndirectCommand)));
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	statistics.end();
+}
+
+// Load, compile, and link the culling and instanced rendering shaders
+bool GPUCuller::initShaders()
+{
+	Shader cShader, vShader, fShader;
+
+	cShader.initFromFile(COMPUTE_SHADER, "shaders/cull.comp");
+	if(!cShader.isCompiled())
+	{
+		cout << "Compute Shader Error" << endl;
+		cout << "" << cShader.log() << endl << endl;
+	}
+	cullProgram.init();
+	cullProgram.addShader(cShader);
+	cullProgram.link();
+	if(!cullProgram.isLinked())
+	{
+		cout << "Shader Linking Error" << endl;
+		cout << "" << cullProgram.log() << endl << endl;
+	}
+	cShader.free();
+
+	vShader.initFromFile(VERTEX_SHADER, "shaders/instanced.vert");
+	if(!vShader.isCompiled())
+	{
+		cout << "Vertex Shader Error" << endl;
+		cout << "" << vShader.log() << endl << endl;
+	}
+	fShader.initFromFile(FRAGMENT_SHADER, "shaders/instanced.frag");
+	if(!fShader.isCompiled())
+	{
+		cout << "Fragment Shader Error" << endl;
+		cout << "" << fShader.log() << endl << endl;
+	}
+	renderProgram.init();
+	renderProgram.addShader(vShader);
+	renderProgram.addShader(fShader);
+	renderProgram.link();
+	if(!renderProgram.isLinked())
+	{
+		cout << "Shader Linking Error" << endl;
+		cout << "" << renderProgram.log() << endl << endl;
+	}
+	vShader.free();
+	fShader.free();
+
+	phaseUniform = cullProgram.getUniform<int>("phase");
+	numInstancesUniform = cullProgram.getUniform<int>("numInstances");
+	frustumCullingUniform = cullProgram.getUniform<int>("frustumCulling");
+	aabbMinUniform = cullProgram.getUniform<glm::vec3>("aabbMin");
+	aabbMaxUniform = cullProgram.getUniform<glm::vec3>("aabbMax");
+	for(int p=0; p<6; p++)
+		planeUniforms[p] = cullProgram.getUniform<glm::vec4>("planes[" + to_string(p) + "]");
+	viewProjectionUniform = cullProgram.getUniform<glm::mat4>("viewProjection");
+	hiZLevelsUniform = cullProgram.getUniform<int>("hiZLevels");
+	hiZUniform = cullProgram.getUniform<int>("hiZ");
+	projectionUniform = renderProgram.getUniform<glm::mat4>("projection");
+	viewUniform = renderProgram.getUniform<glm::mat4>("view");
+
+	return cullProgram.isLinked() && renderProgram.isLinked();
+}
@@ -0,0 +1,78 @@
+#ifndef _GPU_CULLER_INCLUDE
+#define _GPU_CULLER_INCLUDE
+
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+#include "TriangleMesh.h"
+#include "VectorCamera.h"
+#include "QueryPool.h"
+#include "HiZBuffer.h"
+
+
+// GPUCuller keeps the instances of the scene in GPU memory, and tests their
+// AABBs against the view frustum in a compute shader. The survivors are
+// compacted into a second instance buffer, and the GPU also writes the
+// instance count of the indirect draw command that renders them. The whole
+// scene is then submitted with a single draw, whatever the number of instances.
+//
+// For occlusion culling, the instances visible in the last frame are culled and
+// drawn first (PREVIOUSLY_VISIBLE). Then all instances are tested against a
+// hierarchical Z-buffer of that depth (OCCLUSION), which updates their visibility
+// and writes a second draw command with the newly visible ones.
+
+class GPUCuller
+{
+
+public:
+	GPUCuller();
+	~GPUCuller();
+
+	// Upload the instances (3 floats per position and color), and build the instanced VAO
+	bool init(const TriangleMesh &mesh, const float *positions, const float *colors, int count);
+	void free();
+	// Upload new positions and colors of the instances, after they moved
+	void update(const float *positions, const float *colors);
+
+	enum CullPhase
+	{
+		FRUSTUM_ONLY,
+		PREVIOUSLY_VISIBLE,
+		OCCLUSION
+	};
+
+	// Advance the statistics queries, once per frame
+	void beginFrame();
+	// Write the draw command of the phase (command 1 for OCCLUSION, 0 otherwise)
+	void cull(const Frustum &frustum, bool frustumCulling, CullPhase phase = FRUSTUM_ONLY,
+		const HiZBuffer *hiZ = NULL, const glm::mat4 &viewProjection = glm::mat4(1.0f));
+	void render(const glm::mat4 &projection, const glm::mat4 &view, int command = 0);
+
+	bool isReady() const { return ready; }
+	// Number of rendered instances, read back a few frames late so that it never stalls
+	int getVisibleInstances() const { return visibleInstances; }
+
+private:
+	bool initShaders();
+
+private:
+	ShaderProgram cullProgram, renderProgram;
+	// Uniforms of both programs, resolved once after linking
+	UniformHandle<int> phaseUniform, numInstancesUniform, frustumCullingUniform, hiZUniform, hiZLevelsUniform;
+	UniformHandle<glm::vec3> aabbMinUniform, aabbMaxUniform;
+	UniformHandle<glm::vec4> planeUniforms[6];
+	UniformHandle<glm::mat4> viewProjectionUniform, projectionUniform, viewUniform;
+	GLuint instanceBuffer, visibleBuffer, commandBuffer, visibilityBuffer, vao;
+	int nInstances, nVertices;
+	AABB meshAABB;
+	bool ready;
+
+	QueryPool statisticsQueries;
+	int visibleInstances;
+
+};
+
+
+#endif // _GPU_CULLER_INCLUDE
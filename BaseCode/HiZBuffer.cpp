@@ -0,0 +1,144 @@
+#include <iostream>
+#include <algorithm>
+#include "HiZBuffer.h"
+
+
+using namespace std;
+
+
+// Must match the local size in hiz_copy.comp and hiz_reduce.comp
+#define HIZ_GROUP_SIZE 8
+
+
+HiZBuffer::HiZBuffer()
+{
+	depthTexture = pyramid = 0;
+	width = height = levels = 0;
+	ready = false;
+}
+
+HiZBuffer::~HiZBuffer()
+{
+	free();
+}
+
+
+// Load, compile, and link the copy and reduction shaders
+bool HiZBuffer::init()
+{
+	Shader cShader;
+
+	cShader.initFromFile(COMPUTE_SHADER, "shaders/hiz_copy.comp");
+	if(!cShader.isCompiled())
+	{
+		cout << "Compute Shader Error" << endl;
+		cout << "" << cShader.log() << endl << endl;
+	}
+	copyProgram.init();
+	copyProgram.addShader(cShader);
+	copyProgram.link();
+	if(!copyProgram.isLinked())
+	{
+		cout << "Shader Linking Error" << endl;
+		cout << "" << copyProgram.log() << endl << endl;
+	}
+	cShader.free();
+
+	cShader.initFromFile(COMPUTE_SHADER, "shaders/hiz_reduce.comp");
+	if(!cShader.isCompiled())
+	{
+		cout << "Compute Shader Error" << endl;
+		cout << "" << cShader.log() << endl << endl;
+	}
+	reduceProgram.init();
+	reduceProgram.addShader(cShader);
+	reduceProgram.link();
+	if(!reduceProgram.isLinked())
+	{
+		cout << "Shader Linking Error" << endl;
+		cout << "" << reduceProgram.log() << endl << endl;
+	}
+	cShader.free();
+
+	ready = copyProgram.isLinked() && reduceProgram.isLinked();
+	return ready;
+}
+
+void HiZBuffer::free()
+{
+	if(depthTexture != 0)
+		glDeleteTextures(1, &depthTexture);
+	if(pyramid != 0)
+		glDeleteTextures(1, &pyramid);
+	depthTexture = pyramid = 0;
+	width = height = levels = 0;
+	copyProgram.free();
+	reduceProgram.free();
+	ready = false;
+}
+
+void HiZBuffer::build()
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	resize(viewport[2], viewport[3]);
+
+	// Copy the depth buffer
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], width, height);
+
+	copyProgram.use();
+	copyProgram.setUniform1i("depthTexture", 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glBindImageTexture(0, pyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	glDispatchCompute((width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+	// Reduce every level into the next one
+	reduceProgram.use();
+	for(int level=1; level<levels; level++)
+	{
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		int levelWidth = max(width >> level, 1);
+		int levelHeight = max(height >> level, 1);
+		glBindImageTexture(0, pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((levelWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (levelHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+	}
+
+	// The pyramid is sampled by the culling shader
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// (Re)allocate the depth copy and the pyramid when the viewport changes
+void HiZBuffer::resize(int newWidth, int newHeight)
+{
+	if(newWidth == width && newHeight == height)
+		return;
+
+	if(depthTexture != 0)
+		glDeleteTextures(1, &depthTexture);
+	if(pyramid != 0)
+		glDeleteTextures(1, &pyramid);
+
+	width = max(newWidth, 1);
+	height = max(newHeight, 1);
+	levels = 1;
+	while((max(width, height) >> levels) > 0)
+		levels++;
+
+	glGenTextures(1, &depthTexture);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+	glGenTextures(1, &pyramid);
+	glBindTexture(GL_TEXTURE_2D, pyramid);
+	glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,44 @@
+#ifndef _HIZ_BUFFER_INCLUDE
+#define _HIZ_BUFFER_INCLUDE
+
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "ShaderProgram.h"
+
+
+// HiZBuffer builds a hierarchical Z-buffer from the current depth buffer:
+// a mip pyramid where each texel holds the farthest depth of the texels it
+// covers. An AABB whose nearest depth is behind the pyramid texels covering
+// its screen rectangle is occluded.
+
+class HiZBuffer
+{
+
+public:
+	HiZBuffer();
+	~HiZBuffer();
+
+	bool init();
+	void free();
+
+	// Copy the depth buffer of the current viewport and reduce it
+	void build();
+
+	bool isReady() const { return ready; }
+	GLuint getTexture() const { return pyramid; }
+	int getLevels() const { return levels; }
+
+private:
+	void resize(int newWidth, int newHeight);
+
+private:
+	ShaderProgram copyProgram, reduceProgram;
+	GLuint depthTexture, pyramid;
+	int width, height, levels;
+	bool ready;
+
+};
+
+
+#endif // _HIZ_BUFFER_INCLUDE
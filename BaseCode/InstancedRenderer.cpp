@@ -0,0 +1,135 @@
+#include <iostream>
+#include <algorithm>
+#include <glm/gtc/quaternion.hpp>
+#include "InstancedRenderer.h"
+#include "GLState.h"
+
+
+using namespace std;
+
+
+InstancedRenderer::InstancedRenderer()
+{
+	instanceBuffer = vao = 0;
+	maxInstances = nInstances = nVertices = 0;
+}
+
+InstancedRenderer::~InstancedRenderer()
+{
+	free();
+}
+
+
+bool InstancedRenderer::init(const TriangleMesh &mesh, int newMaxInstances)
+{
+	free();
+
+	if(!initShaders())
+		return false;
+
+	maxInstances = newMaxInstances;
+	nVertices = mesh.getNumVertices();
+	staging.reserve(maxInstances);
+
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, maxInstances * sizeof(Instance), NULL, GL_STREAM_DRAW);
+
+	// The VAO reads the mesh vertices per vertex, and the instance buffer per instance
+	glGenVertexArrays(1, &vao);
+	GLState::bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.getVBO());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), 0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (void *)(3*sizeof(float)));
+	GLState::enableVertexAttribArray(0);
+	GLState::enableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for(int attribute=0; attribute<3; attribute++)
+	{
+		glVertexAttribPointer(2 + attribute, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *)(attribute * sizeof(glm::vec4)));
+		glVertexAttribDivisor(2 + attribute, 1);
+		GLState::enableVertexAttribArray(2 + attribute);
+	}
+	GLState::bindVertexArray(0);
+
+	return true;
+}
+
+void InstancedRenderer::free()
+{
+	if(instanceBuffer != 0)
+		glDeleteBuffers(1, &instanceBuffer);
+	if(vao != 0)
+		GLState::deleteVertexArray(vao);
+	instanceBuffer = vao = 0;
+	nInstances = 0;
+	renderProgram.free();
+}
+
+void InstancedRenderer::update(const vector<int> &instances, const vector<glm::mat4> &models, const float *colors)
+{
+	staging.resize(min(int(instances.size()), maxInstances));
+	for(unsigned int k=0; k<staging.size(); k++)
+	{
+		int i = instances[k];
+		glm::quat rotation = glm::quat_cast(glm::mat3(models[i]));
+		staging[k].translation = glm::vec4(glm::vec3(models[i][3]), 1.0f);
+		staging[k].rotation = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+		staging[k].color = glm::vec4(colors[3*i], colors[3*i+1], colors[3*i+2], 1.0f);
+	}
+	nInstances = int(staging.size());
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, maxInstances * sizeof(Instance), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, nInstances * sizeof(Instance), staging.data());
+}
+
+// Render the instances of the last update with a single draw
+void InstancedRenderer::render(const glm::mat4 &projection, const glm::mat4 &view)
+{
+	if(nInstances == 0)
+		return;
+
+	renderProgram.use();
+	renderProgram.setUniform(projectionUniform, projection);
+	renderProgram.setUniform(viewUniform, view);
+
+	GLState::bindVertexArray(vao);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, nVertices, nInstances);
+	GLState::bindVertexArray(0);
+}
+
+// Load, compile, and link the instanced rendering shaders
+bool InstancedRenderer::initShaders()
+{
+	Shader vShader, fShader;
+
+	vShader.initFromFile(VERTEX_SHADER, "shaders/instanced_attribs.vert");
+	if(!vShader.isCompiled())
+	{
+		cout << "Vertex Shader Error" << endl;
+		cout << "" << vShader.log() << endl << endl;
+	}
+	fShader.initFromFile(FRAGMENT_SHADER, "shaders/instanced.frag");
+	if(!fShader.isCompiled())
+	{
+		cout << "Fragment Shader Error" << endl;
+		cout << "" << fShader.log() << endl << endl;
+	}
+	renderProgram.init();
+	renderProgram.addShader(vShader);
+	renderProgram.addShader(fShader);
+	renderProgram.link();
+	if(!renderProgram.isLinked())
+	{
+		cout << "Shader Linking Error" << endl;
+		cout << "" << renderProgram.log() << endl << endl;
+	}
+	vShader.free();
+	fShader.free();
+
+	projectionUniform = renderProgram.getUniform<glm::mat4>("projection");
+	viewUniform = renderProgram.getUniform<glm::mat4>("view");
+
+	return renderProgram.isLinked();
+}
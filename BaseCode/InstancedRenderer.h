@@ -0,0 +1,60 @@
+#ifndef _INSTANCED_RENDERER_INCLUDE
+#define _INSTANCED_RENDERER_INCLUDE
+
+
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+#include "TriangleMesh.h"
+
+
+// InstancedRenderer draws a set of instances of a mesh with a single
+// glDrawArraysInstanced. Every frame, the instances to draw are compacted into
+// an instance vertex buffer, with the translation, rotation (a quaternion) and
+// color of each one, which the vertex shader reads with an attribute divisor.
+// The buffer is orphaned before every upload, so it never waits for the draws
+// of the previous frame.
+
+class InstancedRenderer
+{
+
+public:
+	InstancedRenderer();
+	~InstancedRenderer();
+
+	// Build the instanced VAO over the mesh vertices, for up to maxInstances instances
+	bool init(const TriangleMesh &mesh, int maxInstances);
+	void free();
+
+	// Compact the instances into the instance buffer. Each model matrix must be a
+	// rotation and a translation, and colors holds 3 floats per instance.
+	void update(const std::vector<int> &instances, const std::vector<glm::mat4> &models, const float *colors);
+	void render(const glm::mat4 &projection, const glm::mat4 &view);
+
+	bool isReady() const { return vao != 0; }
+	int getNumInstances() const { return nInstances; }
+
+private:
+	bool initShaders();
+
+private:
+	ShaderProgram renderProgram;
+	UniformHandle<glm::mat4> projectionUniform, viewUniform;
+	GLuint instanceBuffer, vao;
+	int maxInstances, nInstances, nVertices;
+
+	// Layout of the instance buffer, shared with the vertex attributes
+	struct Instance
+	{
+		glm::vec4 translation;
+		glm::vec4 rotation;
+		glm::vec4 color;
+	};
+	std::vector<Instance> staging;
+
+};
+
+
+#endif // _INSTANCED_RENDERER_INCLUDE
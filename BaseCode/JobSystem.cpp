@@ -0,0 +1,172 @@
+#include <algorithm>
+#include "JobSystem.h"
+
+
+using namespace std;
+
+
+// Scheduler and queue of the thread running the code. Threads that are not
+// workers of any scheduler, like the one owning the GL context, use queue 0.
+static thread_local const JobSystem *threadScheduler = NULL;
+static thread_local int threadQueue = 0;
+
+
+JobSystem::JobSystem()
+{
+	running = false;
+	queuedJobs = 0;
+	queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+}
+
+JobSystem::~JobSystem()
+{
+	free();
+}
+
+
+void JobSystem::init(int threads)
+{
+	free();
+
+	if(threads <= 0)
+		threads = max(int(thread::hardware_concurrency()), 1);
+
+	running = true;
+	for(int t=1; t<threads; t++)
+		queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+	for(int t=1; t<threads; t++)
+		workers.push_back(thread(&JobSystem::workerLoop, this, t));
+}
+
+void JobSystem::free()
+{
+	{
+		lock_guard<mutex> guard(sleepLock);
+		running = false;
+	}
+	wakeUp.notify_all();
+	for(thread &worker : workers)
+		worker.join();
+	workers.clear();
+	queues.resize(1);
+}
+
+void JobSystem::parallelFor(int count, int grainSize, const function<void(int, int, int)> &body)
+{
+	if(count <= 0)
+		return;
+
+	int thread = currentThread();
+	grainSize = max(grainSize, 1);
+	int nJobs = (count + grainSize - 1) / grainSize;
+
+	// Not worth a job
+	if(nJobs == 1 || workers.empty())
+	{
+		body(thread, 0, count);
+		return;
+	}
+
+	atomic<int> pending(nJobs);
+	{
+		lock_guard<mutex> guard(queues[thread]->lock);
+		for(int j=0; j<nJobs; j++)
+			queues[thread]->jobs.push_back({ &body, j * grainSize, min((j + 1) * grainSize, count), &pending });
+	}
+	{
+		lock_guard<mutex> guard(sleepLock);
+		queuedJobs += nJobs;
+	}
+	wakeUp.notify_all();
+
+	// Help until all the jobs of this call are done. They may have been stolen,
+	// so this thread may run jobs of other calls in the meantime.
+	while(pending.load(memory_order_acquire) > 0)
+	{
+		Job job;
+		if(popJob(thread, job) || stealJob(thread, job))
+			execute(thread, job);
+		else
+			this_thread::yield();
+	}
+}
+
+void JobSystem::forEachChunk(JobSystem *jobSystem, int nChunks, const function<void(int)> &body)
+{
+	if(jobSystem == NULL)
+	{
+		for(int c=0; c<nChunks; c++)
+			body(c);
+		return;
+	}
+
+	jobSystem->parallelFor(nChunks, 1, [&body](int, int begin, int end)
+	{
+		for(int c=begin; c<end; c++)
+			body(c);
+	});
+}
+
+void JobSystem::workerLoop(int thread)
+{
+	threadScheduler = this;
+	threadQueue = thread;
+
+	while(true)
+	{
+		Job job;
+		if(popJob(thread, job) || stealJob(thread, job))
+		{
+			execute(thread, job);
+			continue;
+		}
+
+		unique_lock<mutex> guard(sleepLock);
+		wakeUp.wait(guard, [this]() { return !running || queuedJobs > 0; });
+		if(!running)
+			return;
+	}
+}
+
+// Newest job of the thread's own queue
+bool JobSystem::popJob(int thread, Job &job)
+{
+	WorkQueue &queue = *queues[thread];
+	lock_guard<mutex> guard(queue.lock);
+	if(queue.jobs.empty())
+		return false;
+
+	job = queue.jobs.back();
+	queue.jobs.pop_back();
+	queuedJobs--;
+	return true;
+}
+
+// Oldest job of any other queue
+bool JobSystem::stealJob(int thread, Job &job)
+{
+	for(size_t i=1; i<queues.size(); i++)
+	{
+		WorkQueue &queue = *queues[(thread + i) % queues.size()];
+		lock_guard<mutex> guard(queue.lock);
+		if(queue.jobs.empty())
+			continue;
+
+		job = queue.jobs.front();
+		queue.jobs.pop_front();
+		queuedJobs--;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::execute(int thread, const Job &job)
+{
+	(*job.body)(thread, job.begin, job.end);
+	job.pending->fetch_sub(1, memory_order_release);
+}
+
+int JobSystem::currentThread() const
+{
+	return threadScheduler == this ? threadQueue : 0;
+}
@@ -0,0 +1,77 @@
+#ifndef _JOB_SYSTEM_INCLUDE
+#define _JOB_SYSTEM_INCLUDE
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// JobSystem is a small work-stealing scheduler. Each thread owns a queue of jobs:
+// it takes work from the back of its own queue, and when it is empty it steals
+// from the front of the others. parallelFor splits a range into jobs and pushes
+// them to the queue of the calling thread, which keeps executing jobs until all
+// of its own are done, so the calling thread is never idle and nested
+// parallelFor calls from a job are safe.
+//
+// Jobs must not touch OpenGL: only the thread that owns the context may do so.
+
+class JobSystem
+{
+
+public:
+	JobSystem();
+	~JobSystem();
+
+	// Start the worker threads. 0 threads uses one per core, including the caller.
+	void init(int threads = 0);
+	void free();
+
+	// Threads running jobs, the calling one included
+	int getNumThreads() const { return int(workers.size()) + 1; }
+
+	// Call body(thread, begin, end) for chunks of at most grainSize elements covering
+	// [0, count), and return when all of them are done. thread is in [0, getNumThreads())
+	// and identifies the thread running the chunk, for per-thread outputs.
+	void parallelFor(int count, int grainSize, const std::function<void(int, int, int)> &body);
+
+	// Call body(chunk) for every chunk in [0, nChunks), in parallel if there is a job system
+	static void forEachChunk(JobSystem *jobSystem, int nChunks, const std::function<void(int)> &body);
+
+private:
+	struct Job
+	{
+		const std::function<void(int, int, int)> *body;
+		int begin, end;
+		std::atomic<int> *pending;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	void workerLoop(int thread);
+	bool popJob(int thread, Job &job);
+	bool stealJob(int thread, Job &job);
+	void execute(int thread, const Job &job);
+	int currentThread() const;
+
+private:
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<bool> running;
+	std::atomic<int> queuedJobs;
+	std::mutex sleepLock;
+	std::condition_variable wakeUp;
+
+};
+
+
+#endif // _JOB_SYSTEM_INCLUDE
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "OccluderMesh.h"
+
+
+using namespace std;
+
+
+OccluderMesh::OccluderMesh()
+{
+	aabb.min = aabb.max = glm::vec3(0.0f);
+	gridSize = glm::ivec3(0);
+	gridOrigin = voxelSize = glm::vec3(0.0f);
+}
+
+
+void OccluderMesh::build(const TriangleMesh &mesh, int resolution, int maxBoxes)
+{
+	free();
+	voxelize(mesh, max(resolution, 1));
+
+	aabb.min = glm::vec3(numeric_limits<float>::max());
+	aabb.max = glm::vec3(-numeric_limits<float>::max());
+
+	// Greedily take the largest box of solid voxels, and remove it from the grid
+	for(int box=0; box<maxBoxes; box++)
+	{
+		glm::ivec3 bestMin(0), bestMax(0);
+		int bestVolume = 0;
+
+		for(int z=0; z<gridSize.z; z++)
+			for(int y=0; y<gridSize.y; y++)
+				for(int x=0; x<gridSize.x; x++)
+				{
+					if(!solid[(z * gridSize.y + y) * gridSize.x + x])
+						continue;
+
+					// Grow along x, then y, then z, while all the voxels are solid
+					glm::ivec3 end(x + 1, y + 1, z + 1);
+					while(end.x < gridSize.x && solid[(z * gridSize.y + y) * gridSize.x + end.x])
+						end.x++;
+					for(bool grows=true; grows && end.y < gridSize.y; )
+					{
+						for(int i=x; i<end.x && grows; i++)
+							grows = solid[(z * gridSize.y + end.y) * gridSize.x + i] != 0;
+						if(grows)
+							end.y++;
+					}
+					for(bool grows=true; grows && end.z < gridSize.z; )
+					{
+						for(int j=y; j<end.y && grows; j++)
+							for(int i=x; i<end.x && grows; i++)
+								grows = solid[(end.z * gridSize.y + j) * gridSize.x + i] != 0;
+						if(grows)
+							end.z++;
+					}
+
+					int volume = (end.x - x) * (end.y - y) * (end.z - z);
+					if(volume > bestVolume)
+					{
+						bestVolume = volume;
+						bestMin = glm::ivec3(x, y, z);
+						bestMax = end;
+					}
+				}
+
+		if(bestVolume == 0)
+			break;
+
+		for(int z=bestMin.z; z<bestMax.z; z++)
+			for(int y=bestMin.y; y<bestMax.y; y++)
+				for(int x=bestMin.x; x<bestMax.x; x++)
+					solid[(z * gridSize.y + y) * gridSize.x + x] = 0;
+
+		addBox(gridOrigin + glm::vec3(bestMin) * voxelSize, gridOrigin + glm::vec3(bestMax) * voxelSize);
+	}
+
+	if(isEmpty())
+		aabb.min = aabb.max = glm::vec3(0.0f);
+	solid.clear();
+}
+
+void OccluderMesh::free()
+{
+	vertices.clear();
+	triangles.clear();
+	solid.clear();
+}
+
+// A voxel is solid if its center is inside the mesh, and no triangle comes near it.
+// Being inside is decided by the parity of the crossings of a line through the center,
+// along each of the three axes: all of them must agree, so that holes in the mesh
+// only make the grid emptier.
+void OccluderMesh::voxelize(const TriangleMesh &mesh, int resolution)
+{
+	const AABB &meshAABB = mesh.getAABB();
+	const vector<glm::vec3> &meshVertices = mesh.getVertices();
+	const vector<int> &meshTriangles = mesh.getTriangles();
+
+	glm::vec3 extent = meshAABB.max - meshAABB.min;
+	float side = max(max(extent.x, extent.y), extent.z) / resolution;
+	if(side <= 0.0f)
+	{
+		gridSize = glm::ivec3(0);
+		return;
+	}
+	gridSize = glm::max(glm::ivec3(glm::ceil(extent / side)), glm::ivec3(1));
+	voxelSize = glm::vec3(side);
+	gridOrigin = meshAABB.min;
+
+	int nVoxels = gridSize.x * gridSize.y * gridSize.z;
+	vector<unsigned char> insideAxes(nVoxels, 0);
+
+	for(int axis=0; axis<3; axis++)
+	{
+		// Lines of voxel centers along the axis, on the (u, v) grid of the other two
+		int u = (axis + 1) % 3, v = (axis + 2) % 3;
+		vector<vector<float>> crossings(gridSize[u] * gridSize[v]);
+
+		for(size_t t=0; t+2<meshTriangles.size(); t+=3)
+		{
+			const glm::vec3 &a = meshVertices[meshTriangles[t]];
+			const glm::vec3 &b = meshVertices[meshTriangles[t + 1]];
+			const glm::vec3 &c = meshVertices[meshTriangles[t + 2]];
+
+			float area = (b[u] - a[u]) * (c[v] - a[v]) - (c[u] - a[u]) * (b[v] - a[v]);
+			if(area == 0.0f)
+				continue;
+
+			int minU = max(int(floor((min(a[u], min(b[u], c[u])) - gridOrigin[u]) / side - 0.5f)), 0);
+			int maxU = min(int(ceil((max(a[u], max(b[u], c[u])) - gridOrigin[u]) / side - 0.5f)), gridSize[u] - 1);
+			int minV = max(int(floor((min(a[v], min(b[v], c[v])) - gridOrigin[v]) / side - 0.5f)), 0);
+			int maxV = min(int(ceil((max(a[v], max(b[v], c[v])) - gridOrigin[v]) / side - 0.5f)), gridSize[v] - 1);
+
+			for(int j=minV; j<=maxV; j++)
+				for(int i=minU; i<=maxU; i++)
+				{
+					float pu = gridOrigin[u] + (i + 0.5f) * side;
+					float pv = gridOrigin[v] + (j + 0.5f) * side;
+
+					// Barycentric coordinates of the line in the projected triangle
+					float wa = ((b[u] - pu) * (c[v] - pv) - (c[u] - pu) * (b[v] - pv)) / area;
+					float wb = ((c[u] - pu) * (a[v] - pv) - (a[u] - pu) * (c[v] - pv)) / area;
+					float wc = 1.0f - wa - wb;
+					if(wa < 0.0f || wb < 0.0f || wc < 0.0f)
+						continue;
+
+					crossings[j * gridSize[u] + i].push_back(wa * a[axis] + wb * b[axis] + wc * c[axis]);
+				}
+		}
+
+		for(int j=0; j<gridSize[v]; j++)
+			for(int i=0; i<gridSize[u]; i++)
+			{
+				vector<float> &line = crossings[j * gridSize[u] + i];
+				sort(line.begin(), line.end());
+
+				size_t next = 0;
+				for(int k=0; k<gridSize[axis]; k++)
+				{
+					float center = gridOrigin[axis] + (k + 0.5f) * side;
+					while(next < line.size() && line[next] < center)
+						next++;
+					if(next % 2 == 0)
+						continue;
+
+					glm::ivec3 voxel;
+					voxel[axis] = k;
+					voxel[u] = i;
+					voxel[v] = j;
+					insideAxes[(voxel.z * gridSize.y + voxel.y) * gridSize.x + voxel.x]++;
+				}
+			}
+	}
+
+	solid.assign(nVoxels, 0);
+	for(int i=0; i<nVoxels; i++)
+		solid[i] = insideAxes[i] == 3;
+
+	// Voxels overlapping the AABB of a triangle may be partially outside
+	for(size_t t=0; t+2<meshTriangles.size(); t+=3)
+	{
+		const glm::vec3 &a = meshVertices[meshTriangles[t]];
+		const glm::vec3 &b = meshVertices[meshTriangles[t + 1]];
+		const glm::vec3 &c = meshVertices[meshTriangles[t + 2]];
+
+		glm::ivec3 first = glm::max(glm::ivec3(glm::floor((glm::min(a, glm::min(b, c)) - gridOrigin) / side)), glm::ivec3(0));
+		glm::ivec3 last = glm::min(glm::ivec3(glm::floor((glm::max(a, glm::max(b, c)) - gridOrigin) / side)), gridSize - 1);
+		for(int z=first.z; z<=last.z; z++)
+			for(int y=first.y; y<=last.y; y++)
+				for(int x=first.x; x<=last.x; x++)
+					solid[(z * gridSize.y + y) * gridSize.x + x] = 0;
+	}
+}
+
+// Add the 12 triangles of a box, counter-clockwise seen from outside
+void OccluderMesh::addBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+{
+	static const int faces[36] =
+	{
+		0, 4, 6,  0, 6, 2,	// -x
+		1, 3, 7,  1, 7, 5,	// +x
+		0, 1, 5,  0, 5, 4,	// -y
+		2, 6, 7,  2, 7, 3,	// +y
+		0, 2, 3,  0, 3, 1,	// -z
+		4, 5, 7,  4, 7, 6	// +z
+	};
+
+	int base = int(vertices.size());
+	// Corner c takes the max coordinate along x, y, z for the bits 1, 2, 4
+	for(int c=0; c<8; c++)
+		vertices.push_back(glm::vec3((c & 1) ? boxMax.x : boxMin.x, (c & 2) ? boxMax.y : boxMin.y, (c & 4) ? boxMax.z : boxMin.z));
+	for(int i=0; i<36; i++)
+		triangles.push_back(base + faces[i]);
+
+	aabb.min = glm::min(aabb.min, boxMin);
+	aabb.max = glm::max(aabb.max, boxMax);
+}
@@ -0,0 +1,53 @@
+#ifndef _OCCLUDER_MESH_INCLUDE
+#define _OCCLUDER_MESH_INCLUDE
+
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "TriangleMesh.h"
+
+
+// OccluderMesh is a low polygon version of a TriangleMesh, used to rasterize it
+// as an occluder. It must be inner-conservative: it has to lie inside the volume
+// of the original mesh, so that it never hides something the mesh would not.
+//
+// The mesh is voxelized, and a voxel is solid when its center is inside the
+// mesh along the three axes and no triangle touches it. Then the largest boxes
+// of solid voxels are extracted greedily, and their faces are the occluder.
+
+class OccluderMesh
+{
+
+public:
+	OccluderMesh();
+
+	// resolution is the number of voxels along the longest side of the mesh AABB
+	void build(const TriangleMesh &mesh, int resolution = 24, int maxBoxes = 8);
+	void free();
+
+	bool isEmpty() const { return triangles.empty(); }
+	const vector<glm::vec3>& getVertices() const { return vertices; }
+	const vector<int>& getTriangles() const { return triangles; }
+	// Bounds of the occluder boxes, smaller than the AABB of the mesh
+	const AABB& getAABB() const { return aabb; }
+	int getNumBoxes() const { return int(vertices.size() / 8); }
+	int getNumTriangles() const { return int(triangles.size() / 3); }
+
+private:
+	void voxelize(const TriangleMesh &mesh, int resolution);
+	void addBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+
+private:
+	vector<glm::vec3> vertices;
+	vector<int> triangles;
+	AABB aabb;
+
+	// Voxel grid of the last build
+	glm::ivec3 gridSize;
+	glm::vec3 gridOrigin, voxelSize;
+	vector<char> solid;
+
+};
+
+
+#endif // _OCCLUDER_MESH_INCLUDE
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/matrix_transform.hpp>
+#include "PVS.h"
+#include "FrustumCuller.h"
+#include "SoftwareRasterizer.h"
+
+
+using namespace std;
+
+
+// Resolution of each face of the cube map the cells are baked with
+#define BAKE_RESOLUTION 128
+// Camera positions per axis of a cell, evenly spaced from one side to the other
+#define BAKE_SAMPLES_PER_AXIS 3
+// Identifies the file format
+#define PVS_MAGIC "PVS1"
+
+
+// Outward frustum planes of a view projection matrix (Gribb & Hartmann)
+static Frustum frustumFromMatrix(const glm::mat4 &m)
+{
+	glm::vec4 rows[4];
+	for(int r=0; r<4; r++)
+		rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+	Frustum frustum;
+	for(int axis=0; axis<3; axis++)
+	{
+		frustum.planes[2 * axis] = -(rows[3] + rows[axis]);
+		frustum.planes[2 * axis + 1] = -(rows[3] - rows[axis]);
+	}
+	return frustum;
+}
+
+
+PVS::PVS()
+{
+	nInstances = wordsPerCell = 0;
+	region.min = region.max = glm::vec3(0.0f);
+	cells = glm::ivec3(0);
+}
+
+
+void PVS::bake(const float *instancePositions, int count, const AABB &meshAABB, const OccluderMesh &occluder,
+	const AABB &bakeRegion, const glm::ivec3 &bakeCells, JobSystem *jobSystem)
+{
+	free();
+	nInstances = count;
+	wordsPerCell = (count + 31) / 32;
+	region = bakeRegion;
+	cells = glm::max(bakeCells, glm::ivec3(1));
+	positions.assign(instancePositions, instancePositions + 3 * count);
+	bits.assign(getNumCells() * wordsPerCell, 0u);
+
+	vector<AABB> aabbs(count);
+	for(int i=0; i<count; i++)
+	{
+		glm::vec3 offset(positions[3*i], positions[3*i+1], positions[3*i+2]);
+		aabbs[i].min = meshAABB.min + offset;
+		aabbs[i].max = meshAABB.max + offset;
+	}
+
+	// Each cell writes only its own words
+	jobSystem->parallelFor(getNumCells(), 1, [&](int, int begin, int end)
+	{
+		for(int cell=begin; cell<end; cell++)
+			bakeCell(cell, aabbs, occluder, jobSystem);
+	});
+}
+
+bool PVS::save(const string &filename) const
+{
+	if(!isReady())
+		return false;
+
+	ofstream fout(filename.c_str(), ios_base::out | ios_base::binary);
+	if(!fout.is_open())
+		return false;
+
+	fout.write(PVS_MAGIC, 4);
+	fout.write((const char *)&nInstances, sizeof(int));
+	fout.write((const char *)&cells, sizeof(glm::ivec3));
+	fout.write((const char *)&region.min, sizeof(glm::vec3));
+	fout.write((const char *)&region.max, sizeof(glm::vec3));
+	fout.write((const char *)positions.data(), positions.size() * sizeof(float));
+	fout.write((const char *)bits.data(), bits.size() * sizeof(unsigned int));
+	return fout.good();
+}
+
+bool PVS::load(const string &filename)
+{
+	free();
+
+	ifstream fin(filename.c_str(), ios_base::in | ios_base::binary);
+	if(!fin.is_open())
+		return false;
+
+	char magic[4];
+	fin.read(magic, 4);
+	fin.read((char *)&nInstances, sizeof(int));
+	fin.read((char *)&cells, sizeof(glm::ivec3));
+	fin.read((char *)&region.min, sizeof(glm::vec3));
+	fin.read((char *)&region.max, sizeof(glm::vec3));
+	if(!fin || memcmp(magic, PVS_MAGIC, 4) != 0 || nInstances < 0 || glm::any(glm::lessThan(cells, glm::ivec3(1))))
+	{
+		free();
+		return false;
+	}
+
+	wordsPerCell = (nInstances + 31) / 32;
+	positions.resize(3 * nInstances);
+	bits.resize(getNumCells() * wordsPerCell);
+	fin.read((char *)positions.data(), positions.size() * sizeof(float));
+	fin.read((char *)bits.data(), bits.size() * sizeof(unsigned int));
+	if(!fin)
+	{
+		free();
+		return false;
+	}
+	return true;
+}
+
+void PVS::free()
+{
+	nInstances = wordsPerCell = 0;
+	cells = glm::ivec3(0);
+	positions.clear();
+	bits.clear();
+}
+
+bool PVS::isBakedFor(const float *instancePositions, int count) const
+{
+	return isReady() && count == nInstances && equal(positions.begin(), positions.end(), instancePositions);
+}
+
+int PVS::findCell(const glm::vec3 &position) const
+{
+	if(!isReady())
+		return -1;
+
+	glm::ivec3 cell = glm::ivec3(glm::floor((position - region.min) / (region.max - region.min) * glm::vec3(cells)));
+	if(glm::any(glm::lessThan(cell, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(cell, cells)))
+		return -1;
+	return (cell.z * cells.y + cell.y) * cells.x + cell.x;
+}
+
+int PVS::getVisibleCount(int cell) const
+{
+	int visible = 0;
+	for(int w=0; w<wordsPerCell; w++)
+		for(unsigned int word = bits[cell * wordsPerCell + w]; word != 0; word &= word - 1)
+			visible++;
+	return visible;
+}
+
+void PVS::bakeCell(int cell, const vector<AABB> &aabbs, const OccluderMesh &occluder, JobSystem *jobSystem)
+{
+	static const glm::vec3 directions[6] =
+	{
+		glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+		glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)
+	};
+	static const glm::vec3 ups[6] =
+	{
+		glm::vec3(0, 1, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, -1),
+		glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(0, 1, 0)
+	};
+
+	glm::ivec3 coords(cell % cells.x, (cell / cells.x) % cells.y, cell / (cells.x * cells.y));
+	glm::vec3 cellSize = (region.max - region.min) / glm::vec3(cells);
+	AABB cellAABB;
+	cellAABB.min = region.min + glm::vec3(coords) * cellSize;
+	cellAABB.max = cellAABB.min + cellSize;
+
+	unsigned int *cellBits = &bits[cell * wordsPerCell];
+	auto markVisible = [cellBits](int i) { cellBits[i / 32] |= 1u << (i % 32); };
+
+	// Instances the camera may be inside of
+	for(int i=0; i<nInstances; i++)
+		if(glm::all(glm::lessThanEqual(aabbs[i].min, cellAABB.max)) && glm::all(glm::lessThanEqual(cellAABB.min, aabbs[i].max)))
+			markVisible(i);
+
+	// One rasterizer per cell, since cells are baked concurrently
+	SoftwareRasterizer rasterizer;
+	rasterizer.init(BAKE_RESOLUTION, BAKE_RESOLUTION, jobSystem);
+	glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.01f, 100.0f);
+	vector<int> inside;
+
+	// A grid of points over the cell, corners included
+	const int nSamples = BAKE_SAMPLES_PER_AXIS * BAKE_SAMPLES_PER_AXIS * BAKE_SAMPLES_PER_AXIS;
+	for(int sample=0; sample<nSamples; sample++)
+	{
+		glm::ivec3 point(sample % BAKE_SAMPLES_PER_AXIS, (sample / BAKE_SAMPLES_PER_AXIS) % BAKE_SAMPLES_PER_AXIS,
+			sample / (BAKE_SAMPLES_PER_AXIS * BAKE_SAMPLES_PER_AXIS));
+		glm::vec3 eye = cellAABB.min + glm::vec3(point) / float(BAKE_SAMPLES_PER_AXIS - 1) * cellSize;
+
+		for(int face=0; face<6; face++)
+		{
+			glm::mat4 viewProjection = projection * glm::lookAt(eye, eye + directions[face], ups[face]);
+			Frustum frustum = frustumFromMatrix(viewProjection);
+
+			inside.clear();
+			for(int i=0; i<nInstances; i++)
+				if(FrustumCuller::isInside(frustum, aabbs[i]))
+					inside.push_back(i);
+
+			rasterizer.clear(viewProjection);
+			for(int i : inside)
+				rasterizer.addOccluder(occluder.getVertices(), occluder.getTriangles(), glm::vec3(positions[3*i], positions[3*i+1], positions[3*i+2]));
+			rasterizer.rasterize();
+
+			for(int i : inside)
+				if(!isVisible(cell, i) && !rasterizer.isOccluded(aabbs[i]))
+					markVisible(i);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef _PVS_INCLUDE
+#define _PVS_INCLUDE
+
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "TriangleMesh.h"
+#include "OccluderMesh.h"
+#include "JobSystem.h"
+
+
+// PVS holds the potentially visible set of instances of every view cell, the
+// cells being a regular grid over the region the camera can move in.
+//
+// The sets are baked offline. For every cell, the camera is placed on a 3x3x3
+// grid of points spanning it, and from each of these points the occluder meshes
+// of all the instances are rasterized on the CPU into the six faces of a cube
+// map. An instance is in the set if its AABB passes the frustum and depth test of
+// any face, or if it overlaps the cell. Cells are baked in parallel on the job
+// system.
+//
+// The sets are not conservative: they are sampled from a few points at a finite
+// resolution. An instance seen only through a gap thinner than the spacing of the
+// points, or than a cube map texel, can be missing from the set of its cell.
+//
+// The file stores the instance positions the sets were baked for, followed by
+// one bitset per cell. The sets are only valid for that layout, which
+// isBakedFor() checks.
+
+class PVS
+{
+
+public:
+	PVS();
+
+	void bake(const float *positions, int count, const AABB &meshAABB, const OccluderMesh &occluder,
+		const AABB &region, const glm::ivec3 &cells, JobSystem *jobSystem);
+	bool save(const std::string &filename) const;
+	bool load(const std::string &filename);
+	void free();
+
+	bool isReady() const { return !bits.empty(); }
+	int getNumInstances() const { return nInstances; }
+	// True if the sets were baked for exactly these instance positions
+	bool isBakedFor(const float *instancePositions, int count) const;
+	const float *getPositions() const { return positions.data(); }
+	int getNumCells() const { return cells.x * cells.y * cells.z; }
+
+	// Cell containing a position, or -1 outside the region
+	int findCell(const glm::vec3 &position) const;
+	bool isVisible(int cell, int instance) const
+	{
+		return (bits[cell * wordsPerCell + instance / 32] >> (instance % 32)) & 1u;
+	}
+	int getVisibleCount(int cell) const;
+
+private:
+	void bakeCell(int cell, const std::vector<AABB> &aabbs, const OccluderMesh &occluder, JobSystem *jobSystem);
+
+private:
+	int nInstances, wordsPerCell;
+	AABB region;
+	glm::ivec3 cells;
+	std::vector<float> positions;
+	std::vector<unsigned int> bits;
+
+};
+
+
+#endif // _PVS_INCLUDE
@@ -0,0 +1,157 @@
+#include "QuadTree.h"
+
+#include <algorithm>
+#include <limits>
+
+
+unsigned int QuadTree::mortonCode(unsigned int x, unsigned int z)
+{
+    // Spread the 16 low bits of each coordinate over the even bits
+    x &= 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    z &= 0xffff;
+    z = (z | (z << 8)) & 0x00ff00ff;
+    z = (z | (z << 4)) & 0x0f0f0f0f;
+    z = (z | (z << 2)) & 0x33333333;
+    z = (z | (z << 1)) & 0x55555555;
+    return x | (z << 1);
+}
+
+void QuadTree::build(const float *positions, int count, const AABB &meshAABB, int depth, JobSystem *jobSystem)
+{
+    // Morton codes of the leaves must fit in 32 bits
+    depth = std::min(std::max(depth, 0), 15);
+
+    // A complete quadtree has (4^(depth+1) - 1) / 3 nodes, the last 4^depth being leaves
+    std::size_t nNodes = ((std::size_t(1) << (2 * (depth + 1))) - 1) / 3;
+    std::size_t nLeaves = std::size_t(1) << (2 * depth);
+    std::size_t firstLeaf = nNodes - nLeaves;
+    int resolution = 1 << depth;
+
+    nodes.assign(nNodes, QuadTreeNode());
+    for (QuadTreeNode &node : nodes)
+    {
+        node.aabb.min = glm::vec3(std::numeric_limits<float>::max());
+        node.aabb.max = glm::vec3(-std::numeric_limits<float>::max());
+        node.begin = node.end = 0;
+        node.visible = false;
+        node.lastVisited = 0;
+        node.nextQueryFrame = 0;
+        node.invisibleFrames = 0;
+        node.lastFailingPlane = 0;
+    }
+
+    count = std::max(count, 0);
+    instances.resize(count);
+    codes.resize(count);
+    if (count == 0)
+        return;
+
+    // Split the instances in a few chunks per thread, so that idle threads can steal some
+    int nChunks = (jobSystem != NULL) ? 4 * jobSystem->getNumThreads() : 1;
+    int chunkSize = (count + nChunks - 1) / nChunks;
+    nChunks = (count + chunkSize - 1) / chunkSize;
+
+    // XZ extent of the instance positions
+    std::vector<glm::vec2> chunkMin(nChunks, glm::vec2(std::numeric_limits<float>::max()));
+    std::vector<glm::vec2> chunkMax(nChunks, glm::vec2(-std::numeric_limits<float>::max()));
+    JobSystem::forEachChunk(jobSystem, nChunks, [&](int c)
+    {
+        for (int i = c * chunkSize; i < std::min((c + 1) * chunkSize, count); ++i)
+        {
+            glm::vec2 p(positions[i*3], positions[i*3 + 2]);
+            chunkMin[c] = glm::min(chunkMin[c], p);
+            chunkMax[c] = glm::max(chunkMax[c], p);
+        }
+    });
+    glm::vec2 minPos = chunkMin[0], maxPos = chunkMax[0];
+    for (int c = 1; c < nChunks; ++c)
+    {
+        minPos = glm::min(minPos, chunkMin[c]);
+        maxPos = glm::max(maxPos, chunkMax[c]);
+    }
+    glm::vec2 cellSize = glm::max((maxPos - minPos) / float(resolution), glm::vec2(1e-5f));
+
+    // Code of the leaf covering the grid cell of every instance
+    JobSystem::forEachChunk(jobSystem, nChunks, [&](int c)
+    {
+        for (int i = c * chunkSize; i < std::min((c + 1) * chunkSize, count); ++i)
+        {
+            int cx = std::min(int((positions[i*3] - minPos.x) / cellSize.x), resolution - 1);
+            int cz = std::min(int((positions[i*3 + 2] - minPos.y) / cellSize.y), resolution - 1);
+            codes[i] = mortonCode(cx, cz);
+            instances[i] = i;
+        }
+    });
+
+    // Sort the instances by the code of their leaf
+    radixSort.sort(codes, instances, 2 * depth, jobSystem);
+
+    // Leaf ranges. The leaves are in Morton order, so leaf l holds code l.
+    auto findLeafRanges = [&](int, int begin, int end)
+    {
+        for (int l = begin; l < end; ++l)
+        {
+            QuadTreeNode &leaf = nodes[firstLeaf + l];
+            leaf.begin = int(std::lower_bound(codes.begin(), codes.end(), unsigned(l)) - codes.begin());
+            leaf.end = int(std::lower_bound(codes.begin() + leaf.begin, codes.end(), unsigned(l) + 1) - codes.begin());
+        }
+    };
+    if (jobSystem != NULL)
+        jobSystem->parallelFor(int(nLeaves), 256, findLeafRanges);
+    else
+        findLeafRanges(0, 0, int(nLeaves));
+
+    // Interior nodes bottom-up: the first and last children delimit the range
+    for (std::size_t i = firstLeaf; i-- > 0; )
+    {
+        nodes[i].begin = nodes[child(i, 0)].begin;
+        nodes[i].end = nodes[child(i, 3)].end;
+    }
+
+    refit(positions, meshAABB, jobSystem);
+}
+
+void QuadTree::refit(const float *positions, const AABB &meshAABB, JobSystem *jobSystem)
+{
+    // A complete quadtree has 4 * firstLeaf + 1 nodes
+    std::size_t firstLeaf = nodes.size() / 4;
+
+    // Leaf bounds, from the instances of their range
+    auto refitLeaves = [&](int, int begin, int end)
+    {
+        for (std::size_t l = firstLeaf + begin; l < firstLeaf + end; ++l)
+        {
+            QuadTreeNode &leaf = nodes[l];
+            leaf.aabb.min = glm::vec3(std::numeric_limits<float>::max());
+            leaf.aabb.max = glm::vec3(-std::numeric_limits<float>::max());
+            for (int k = leaf.begin; k < leaf.end; ++k)
+            {
+                int i = instances[k];
+                glm::vec3 offset(positions[i*3], positions[i*3 + 1], positions[i*3 + 2]);
+                leaf.aabb.min = glm::min(leaf.aabb.min, meshAABB.min + offset);
+                leaf.aabb.max = glm::max(leaf.aabb.max, meshAABB.max + offset);
+            }
+        }
+    };
+    int nLeaves = int(nodes.size() - firstLeaf);
+    if (jobSystem != NULL)
+        jobSystem->parallelFor(nLeaves, 256, refitLeaves);
+    else
+        refitLeaves(0, 0, nLeaves);
+
+    // Interior bounds bottom-up, as the union of the children
+    for (std::size_t i = firstLeaf; i-- > 0; )
+    {
+        QuadTreeNode &n = nodes[i];
+        n.aabb = nodes[child(i, 0)].aabb;
+        for (int c = 1; c < 4; ++c)
+        {
+            n.aabb.min = glm::min(n.aabb.min, nodes[child(i, c)].aabb.min);
+            n.aabb.max = glm::max(n.aabb.max, nodes[child(i, c)].aabb.max);
+        }
+    }
+}
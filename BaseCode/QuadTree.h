@@ -1,4 +1,9 @@
+#ifndef _QUAD_TREE_INCLUDE
+#define _QUAD_TREE_INCLUDE
+
 #include "TriangleMesh.h"
+#include "JobSystem.h"
+#include "RadixSort.h"
 
 #include "glm/glm.hpp"
 #include <vector>
@@ -9,14 +14,33 @@ using QuadTreeNodeIndex = std::size_t;
 struct QuadTreeNode
 {
     AABB aabb;
-    std::vector<glm::vec3> modelPositions;
+    int begin, end;                 // Range of QuadTree::instances below the node
     bool visible;
     unsigned int lastVisited;
+    unsigned int nextQueryFrame;    // CHC++: first frame in which a visible node is queried again
+    unsigned int invisibleFrames;   // CHC++: number of consecutive frames the node was invisible
+    int lastFailingPlane;           // Frustum plane that culled the node the last time
 };
 
+// Complete quadtree over the XZ plane, stored implicitly:
+// the children of node i are 4*i+1 ... 4*i+4
+//
+// The tree is linear: the instances are sorted by the Morton code of their leaf,
+// which interleaves the bits of its cell coordinates in the same order as the
+// child indices. The instances below any node are then contiguous in the sorted
+// array, and each node only stores their [begin, end) range.
 struct QuadTree
 {
     std::vector<QuadTreeNode> nodes;
+    std::vector<int> instances;     // Indices of the scene instances, sorted by leaf
+
+    // Build a tree of the given depth over the instance positions (3 floats per instance)
+    // Node AABBs are the tight union of the AABBs of the instances they contain
+    // The sort and the leaf bounds run on the job system, if any
+    void build(const float *positions, int count, const AABB &meshAABB, int depth, JobSystem *jobSystem = NULL);
+    // Recompute the node bounds after the instances moved. They stay in their leaves,
+    // which may then overlap, but the bounds are still tight.
+    void refit(const float *positions, const AABB &meshAABB, JobSystem *jobSystem = NULL);
 
     QuadTreeNodeIndex root()
     {
@@ -28,6 +52,11 @@ struct QuadTree
         return (i-1)/4;
     }
 
+    QuadTreeNodeIndex child (QuadTreeNodeIndex i, int c)
+    {
+        return 4*i + 1 + c;
+    }
+
     bool hasParent (QuadTreeNodeIndex i)
     {
         return i > 0;
@@ -39,4 +68,20 @@ struct QuadTree
         return child >= nodes.size();
     }
 
-};
\ No newline at end of file
+    // Nodes without any instance below them have an empty range of instances
+    bool isEmpty (QuadTreeNodeIndex i)
+    {
+        return nodes[i].begin == nodes[i].end;
+    }
+
+    // Interleave the bits of a cell, x taking the even ones and z the odd ones
+    static unsigned int mortonCode (unsigned int x, unsigned int z);
+
+private:
+    // Morton code of every instance, sorted with the instances
+    std::vector<unsigned int> codes;
+    RadixSort<int> radixSort;
+
+};
+
+#endif // _QUAD_TREE_INCLUDE
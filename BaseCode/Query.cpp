@@ -1,24 +1,23 @@
 #include "Query.h"
 
-Query::Query(GLuint id)
+Query::Query(GLuint id, GLenum target)
     : id(id)
+    , target(target)
     {}
 
 void Query::begin() const
 {
-    glBeginQuery(GL_ANY_SAMPLES_PASSED, id);
+    glBeginQuery(target, id);
 }
 
 void Query::end() const
 {
-    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    glEndQuery(target);
 }
 
-bool Query::isVisible() const
+bool Query::isVisible(GLuint minSamples) const
 {
-    GLint param;
-    glGetQueryObjectiv(id, GL_QUERY_RESULT, &param);
-    return param == GL_TRUE;
+    return result() >= minSamples;
 }
 
 bool Query::resultIsReady() const
@@ -27,6 +26,23 @@ bool Query::resultIsReady() const
     glGetQueryObjectiv(id, GL_QUERY_RESULT_AVAILABLE, &param);
     return param == GL_TRUE;
 }
+
+GLuint Query::result() const
+{
+    GLuint param;
+    glGetQueryObjectuiv(id, GL_QUERY_RESULT, &param);
+    return param;
+}
+
+void Query::beginConditionalRender(GLenum mode) const
+{
+    glBeginConditionalRender(id, mode);
+}
+
+void Query::endConditionalRender() const
+{
+    glEndConditionalRender();
+}
 // #include "Query.h"
 
 // Query::Query()
@@ -7,13 +7,19 @@
 class Query
 {
 public:
-    Query(GLuint id);
+    Query(GLuint id, GLenum target = GL_ANY_SAMPLES_PASSED);
     void begin() const;
     void end() const;
-    bool isVisible() const;
+    // At least minSamples samples passed. GL_ANY_SAMPLES_PASSED queries only count up to 1.
+    bool isVisible(GLuint minSamples = 1) const;
     bool resultIsReady() const;
+    GLuint result() const;
+    // Let the GPU skip the draws in between if the query did not pass
+    void beginConditionalRender(GLenum mode = GL_QUERY_NO_WAIT) const;
+    void endConditionalRender() const;
 private:
     GLuint id;
+    GLenum target;
 };
 
 #endif
@@ -1,10 +1,17 @@
 #include "QueryPool.h"
 
-QueryPool::QueryPool(int n)
-    : ids(n)
+#include <algorithm>
+#include <utility>
+
+QueryPool::QueryPool(int n, int frames, GLenum target)
+    : target(target)
+    , n(0)
+    , nFrames(std::max(frames, 1))
+    , frame(0)
+    , serial(1)
     , i(0)
 {
-    glGenQueries(ids.size(), ids.data());
+    resize(n);
 }
 
 QueryPool::QueryPool()
@@ -13,15 +20,100 @@ QueryPool::QueryPool()
 
 QueryPool::~QueryPool()
 {
-    glDeleteQueries(ids.size(), ids.data());
+    release();
+}
+
+QueryPool::QueryPool(QueryPool &&other)
+    : QueryPool()
+{
+    *this = std::move(other);
+}
+
+QueryPool &QueryPool::operator=(QueryPool &&other)
+{
+    if (this != &other)
+    {
+        release();
+        ids = std::move(other.ids);
+        issued = std::move(other.issued);
+        target = other.target;
+        n = other.n;
+        nFrames = other.nFrames;
+        frame = other.frame;
+        serial = other.serial;
+        i = other.i;
+
+        other.ids.clear();
+        other.issued.clear();
+        other.n = 0;
+        other.i = 0;
+    }
+    return *this;
+}
+
+void QueryPool::resize(int newSize)
+{
+    if (newSize <= n)
+        return;
+
+    // Keep the queries of every frame, and generate the new ones
+    std::vector<GLuint> newIds(newSize * nFrames);
+    std::vector<unsigned int> newIssued(newSize * nFrames, 0);
+    for (int f = 0; f < nFrames; ++f)
+    {
+        std::copy(ids.begin() + f * n, ids.begin() + (f + 1) * n, newIds.begin() + f * newSize);
+        std::copy(issued.begin() + f * n, issued.begin() + (f + 1) * n, newIssued.begin() + f * newSize);
+        glGenQueries(newSize - n, newIds.data() + f * newSize + n);
+    }
+
+    ids.swap(newIds);
+    issued.swap(newIssued);
+    n = newSize;
+}
+
+void QueryPool::nextFrame()
+{
+    frame = (frame + 1) % nFrames;
+    serial++;
+    i = 0;
 }
 
 Query QueryPool::getQuery()
 {
-    return Query(ids[i++]);
+    if (i >= n)
+        resize(std::max(2 * n, 1));
+    return getQuery(i++);
+}
+
+Query QueryPool::getQuery(int index)
+{
+    issued[slot(index, 0)] = serial;
+    return Query(ids[slot(index, 0)], target);
+}
+
+Query QueryPool::getQuery(int index, int framesAgo) const
+{
+    return Query(ids[slot(index, framesAgo)], target);
+}
+
+bool QueryPool::wasIssued(int index, int framesAgo) const
+{
+    // Queries never handed out are stamped with 0, which is never a valid serial
+    return framesAgo < nFrames && serial > unsigned(framesAgo) && issued[slot(index, framesAgo)] == serial - framesAgo;
 }
 
 void QueryPool::clear()
 {
     i = 0;
-}
\ No newline at end of file
+}
+
+int QueryPool::slot(int index, int framesAgo) const
+{
+    return ((frame - framesAgo % nFrames + nFrames) % nFrames) * n + index;
+}
+
+void QueryPool::release()
+{
+    if (!ids.empty())
+        glDeleteQueries(ids.size(), ids.data());
+}
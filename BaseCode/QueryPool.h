@@ -5,17 +5,56 @@
 
 #include <vector>
 
+// QueryPool owns a ring of query objects: n queries for each of the frames in flight,
+// so that every instance or node can keep its own query alive for several frames.
+// Advancing to the next frame is O(1) and does not allocate. The pool is move-only,
+// since it deletes its GL queries on destruction.
+// The default constructor does not touch GL, so a pool can be a member of
+// objects created before the GL context, and be filled later on.
 class QueryPool
 {
 public:
     QueryPool();
-    QueryPool(int n);
+    QueryPool(int n, int frames = 1, GLenum target = GL_ANY_SAMPLES_PASSED);
     ~QueryPool();
+
+    QueryPool(const QueryPool &) = delete;
+    QueryPool &operator=(const QueryPool &) = delete;
+    QueryPool(QueryPool &&other);
+    QueryPool &operator=(QueryPool &&other);
+
+    // Grow every frame of the ring to hold at least n queries
+    void resize(int n);
+    // Move to the next frame of the ring, reusing its oldest queries
+    void nextFrame();
+
+    // Next unused query of the current frame, growing the pool when exhausted
     Query getQuery();
+    // Query at index in the current frame, which is marked as issued
+    Query getQuery(int index);
+    // Query at index from framesAgo frames ago (at most frames() - 1)
+    Query getQuery(int index, int framesAgo) const;
+    // Whether the query at index was handed out framesAgo frames ago
+    bool wasIssued(int index, int framesAgo) const;
+
+    int size() const { return n; }
+    int frames() const { return nFrames; }
+    // Block of the ring used framesAgo frames ago, to index per-frame data kept alongside
+    int ringFrame(int framesAgo = 0) const { return (frame - framesAgo + nFrames) % nFrames; }
+
+    // Restart the unused query counter of the current frame
     void clear();
 private:
-    std::vector<GLuint> ids;
+    int slot(int index, int framesAgo) const;
+    void release();
+
+    std::vector<GLuint> ids;            // nFrames blocks of n queries
+    std::vector<unsigned int> issued;   // Frame serial in which each query was handed out
+    GLenum target;
+    int n, nFrames;
+    int frame;                          // Current block of the ring
+    unsigned int serial;                // Number of frames since the creation of the pool
     int i;
 };
 
-#endif // _INCLUDE_QUERY_POOL
\ No newline at end of file
+#endif // _INCLUDE_QUERY_POOL
@@ -0,0 +1,84 @@
+#ifndef _RADIX_SORT_INCLUDE
+#define _RADIX_SORT_INCLUDE
+
+
+#include <vector>
+#include <algorithm>
+#include "JobSystem.h"
+
+
+// RadixSort is a stable LSD radix sort of unsigned int keys, each carrying a
+// payload of type T, RADIX_SORT_BITS per pass. The keys are split into chunks:
+// every chunk counts its digits, and the prefix sum over (digit, chunk) gives
+// each chunk its own output offsets, so the scatter runs in parallel too. The
+// buffers are kept between sorts.
+
+#define RADIX_SORT_BITS 8
+#define RADIX_SORT_SIZE (1 << RADIX_SORT_BITS)
+
+
+template<class T>
+class RadixSort
+{
+
+public:
+	// Sort keys and payloads together by the keyBits low bits of the keys
+	void sort(std::vector<unsigned int> &keys, std::vector<T> &payloads, int keyBits, JobSystem *jobSystem);
+
+private:
+	std::vector<unsigned int> swapKeys, histograms;
+	std::vector<T> swapPayloads;
+
+};
+
+
+template<class T>
+void RadixSort<T>::sort(std::vector<unsigned int> &keys, std::vector<T> &payloads, int keyBits, JobSystem *jobSystem)
+{
+	int count = int(keys.size());
+	if(count == 0)
+		return;
+	int nChunks = (jobSystem != NULL) ? 4 * jobSystem->getNumThreads() : 1;
+	int chunkSize = (count + nChunks - 1) / nChunks;
+	nChunks = (count + chunkSize - 1) / chunkSize;
+
+	swapKeys.resize(count);
+	swapPayloads.resize(count);
+
+	for(int shift=0; shift<keyBits; shift+=RADIX_SORT_BITS)
+	{
+		histograms.assign(nChunks * RADIX_SORT_SIZE, 0);
+		JobSystem::forEachChunk(jobSystem, nChunks, [&](int c)
+		{
+			unsigned int *histogram = &histograms[c * RADIX_SORT_SIZE];
+			for(int i=c*chunkSize; i<std::min((c + 1) * chunkSize, count); i++)
+				histogram[(keys[i] >> shift) & (RADIX_SORT_SIZE - 1)]++;
+		});
+
+		unsigned int offset = 0;
+		for(int d=0; d<RADIX_SORT_SIZE; d++)
+			for(int c=0; c<nChunks; c++)
+			{
+				unsigned int digitCount = histograms[c * RADIX_SORT_SIZE + d];
+				histograms[c * RADIX_SORT_SIZE + d] = offset;
+				offset += digitCount;
+			}
+
+		JobSystem::forEachChunk(jobSystem, nChunks, [&](int c)
+		{
+			unsigned int *histogram = &histograms[c * RADIX_SORT_SIZE];
+			for(int i=c*chunkSize; i<std::min((c + 1) * chunkSize, count); i++)
+			{
+				unsigned int position = histogram[(keys[i] >> shift) & (RADIX_SORT_SIZE - 1)]++;
+				swapKeys[position] = keys[i];
+				swapPayloads[position] = payloads[i];
+			}
+		});
+
+		keys.swap(swapKeys);
+		payloads.swap(swapPayloads);
+	}
+}
+
+
+#endif // _RADIX_SORT_INCLUDE
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cstring>
+#include "RenderQueue.h"
+
+
+using namespace std;
+
+
+// Widths of the fields of the sort key
+#define KEY_MESH_BITS 8
+#define KEY_DEPTH_BITS 32
+#define KEY_PACKET_BITS 16
+
+
+int RenderQueue::addProgram(ShaderProgram *program, const UniformHandle<int> &instance)
+{
+	programs.push_back({ program, instance });
+	return int(programs.size()) - 1;
+}
+
+int RenderQueue::addMesh(const TriangleMesh *mesh)
+{
+	meshes.push_back(mesh);
+	return int(meshes.size()) - 1;
+}
+
+void RenderQueue::setMesh(int mesh, const TriangleMesh *newMesh)
+{
+	meshes[mesh] = newMesh;
+}
+
+void RenderQueue::clear()
+{
+	packets.clear();
+	keys.clear();
+}
+
+bool RenderQueue::push(int program, int mesh, int instance, float depth)
+{
+	if(packets.size() >= (size_t(1) << KEY_PACKET_BITS))
+		return false;
+
+	packets.push_back({ program, mesh, instance, depth });
+	return true;
+}
+
+void RenderQueue::sort()
+{
+	keys.resize(packets.size());
+	for(unsigned int k=0; k<packets.size(); k++)
+	{
+		const RenderPacket &packet = packets[k];
+
+		// Behind the camera only happens to instances around it, which go first
+		float depth = max(packet.depth, 0.0f);
+		uint32_t depthBits;
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+
+		keys[k] = (uint64_t(packet.program) << (KEY_MESH_BITS + KEY_DEPTH_BITS + KEY_PACKET_BITS)) |
+		          (uint64_t(packet.mesh) << (KEY_DEPTH_BITS + KEY_PACKET_BITS)) |
+		          (uint64_t(depthBits) << KEY_PACKET_BITS) | uint64_t(k);
+	}
+	std::sort(keys.begin(), keys.end());
+}
+
+int RenderQueue::submit()
+{
+	if(keys.size() != packets.size())
+		sort();
+	programChanges = meshChanges = 0;
+
+	int lastProgram = -1, lastMesh = -1;
+	for(uint64_t key : keys)
+	{
+		const RenderPacket &packet = packets[key & ((uint64_t(1) << KEY_PACKET_BITS) - 1)];
+		const QueueProgram &program = programs[packet.program];
+
+		if(packet.program != lastProgram)
+		{
+			program.program->use();
+			lastProgram = packet.program;
+			programChanges++;
+		}
+		if(packet.mesh != lastMesh)
+		{
+			lastMesh = packet.mesh;
+			meshChanges++;
+		}
+		program.program->setUniform(program.instance, packet.instance);
+		meshes[packet.mesh]->render();
+	}
+
+	return int(keys.size());
+}
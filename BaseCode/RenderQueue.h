@@ -0,0 +1,69 @@
+#ifndef _RENDER_QUEUE_INCLUDE
+#define _RENDER_QUEUE_INCLUDE
+
+
+#include <vector>
+#include <cstdint>
+#include "ShaderProgram.h"
+#include "TriangleMesh.h"
+
+
+// A draw of a registered mesh with a registered program. The instance indexes
+// the per-instance data of the uniform blocks, and the depth is the view space
+// distance of the instance.
+struct RenderPacket
+{
+	int program, mesh;
+	int instance;
+	float depth;
+};
+
+
+// RenderQueue separates choosing what to draw from drawing it. The scene
+// traversal pushes render packets, sort() orders them by a 64-bit key, and
+// submit() draws them all in a single loop.
+//
+// From the most significant bits, the key holds the program (8 bits), the mesh
+// (8 bits), the depth (32 bits) and the packet index (16 bits). The draws are
+// then grouped by program and by mesh, to change them the least, and front to
+// back within each group. A non-negative float sorts like its bits taken as an
+// unsigned int, so the depth needs no quantization.
+
+class RenderQueue
+{
+
+public:
+	// Programs must have an int uniform selecting the instance
+	int addProgram(ShaderProgram *program, const UniformHandle<int> &instance);
+	int addMesh(const TriangleMesh *mesh);
+	void setMesh(int mesh, const TriangleMesh *newMesh);
+
+	void clear();
+	// Returns false when the queue is full
+	bool push(int program, int mesh, int instance, float depth);
+	void sort();
+	// Draw the packets in key order, sorting them first if needed, and return the number of draws
+	int submit();
+
+	int getNumPackets() const { return int(packets.size()); }
+	// Program and mesh changes of the last submit
+	int getProgramChanges() const { return programChanges; }
+	int getMeshChanges() const { return meshChanges; }
+
+private:
+	struct QueueProgram
+	{
+		ShaderProgram *program;
+		UniformHandle<int> instance;
+	};
+
+	std::vector<QueueProgram> programs;
+	std::vector<const TriangleMesh *> meshes;
+	std::vector<RenderPacket> packets;
+	std::vector<uint64_t> keys;
+	int programChanges = 0, meshChanges = 0;
+
+};
+
+
+#endif // _RENDER_QUEUE_INCLUDE
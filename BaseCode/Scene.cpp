@@ -11,6 +11,8 @@
 #include <fstream>
 #include <string>
 #include <random>
+#include <algorithm>
+#include <chrono>
 
 #include "Scene.h"
 
@@ -19,6 +21,7 @@ Scene::Scene()
 {
 	cube = NULL;
 	mesh = NULL;
+	proxyMesh = NULL;
 }
 
 Scene::~Scene()
@@ -27,6 +30,8 @@ Scene::~Scene()
 		delete cube;
 	if(mesh != NULL)
 		delete mesh;
+	if(proxyMesh != NULL)
+		delete proxyMesh;
 }
 
 // Get the camera
@@ -50,18 +55,34 @@ void Scene::init()
 {
 	// Init the rendering booleans
 	viewFrustumCulling  = false;
+	cullingHierarchy = FLAT_CULLING;
+	animateInstances = false;
+	bvhRebuiltSubtrees = 0;
+	cullingTime = 0.0f;
+	contributionCulled = 0;
+	obbCulled = 0;
+	depthSortReused = false;
+	depthPrePass = NO_DEPTH_PREPASS;
+	prePassDraws = 0;
+	shadingDepthFunc = GL_LESS;
+	queueSubmits = queueProgramChanges = 0;
+	pvsCell = -1;
 	isAABBRendered 		= false;
+	isOcclusionCulled	= false;
 	renderingMode 		= false;
 	shaderMode			= false;
-	firstTimeQueries 	= true;
-
-	// For some reason, I can't initialize QueryPool queryPool in Scene.h
-	// so I push it back inside a vector
-	QueryPool queryPool;
-	queryPool = QueryPool(modelCopies);
-    queryPool.clear();
-	qp.push_back(queryPool);
-	
+	renderedModels		= 0;
+	issuedQueries		= 0;
+	skippedDraws		= 0;
+	softwareOccluderTriangles = 0;
+
+	// Worker threads for culling and per-instance preparation
+	jobSystem.init();
+
+	// Queries can only be generated once the GL context exists
+	// The queries read back by the CPU count samples, for the contribution culling
+	stopAndWaitQueries = QueryPool(modelCopies, 1, GL_SAMPLES_PASSED);
+
 	// Init the Shaders
 	initShaders();
 
@@ -94,6 +115,55 @@ void Scene::init()
 			colors[i*3+1] = getRandomFloat(0.0f, 1.0f);
 			colors[i*3+2] = getRandomFloat(0.0f, 1.0f);
 		}
+
+		std::copy(positions, positions + 3 * modelCopies, randomPositions);
+
+		// Saved potentially visible sets only apply to the layout they were baked for,
+		// so the one loaded is kept to restore its layout later
+		if (pvs.load(pvsFilename) && pvs.getNumInstances() == modelCopies)
+		{
+			if (restorePVSLayout)
+				std::copy(pvs.getPositions(), pvs.getPositions() + 3 * modelCopies, positions);
+		}
+		else
+		{
+			pvs.free();
+			restorePVSLayout = false;
+		}
+
+		// Culling structures over the instances, and the quadtree with one query per node for CHC
+		buildInstanceStructures();
+		frustumVisibleInstances.reserve(modelCopies);
+		instanceModels.resize(modelCopies);
+		instanceModelviews.resize(modelCopies);
+
+		// CHC++ may query every node twice per frame when its multiqueries fail
+		chcQueries = QueryPool(2 * quadTree.nodes.size(), 1, GL_SAMPLES_PASSED);
+		multiQueryNodes.reserve(2 * quadTree.nodes.size());
+		invisibleQueue.reserve(quadTree.nodes.size());
+		randomGenerator.seed(std::random_device()());
+
+		// Queries of the asynchronous mode, for each of the frames in flight
+		asyncQueries = QueryPool(modelCopies, maxQueryLatency + 1, GL_SAMPLES_PASSED);
+
+		// Queries of the conditional rendering mode
+		conditionalQueries = QueryPool(modelCopies);
+		statisticsQueries = QueryPool(1, maxQueryLatency + 1, GL_PRIMITIVES_GENERATED);
+
+		// Upload the instances for the GPU-driven culling
+		if (!gpuCuller.init(*mesh, positions, colors, modelCopies))
+			cout << "GPU culling is not available" << endl;
+		if (!instancedRenderer.init(*mesh, modelCopies))
+			cout << "Instanced rendering is not available" << endl;
+		if (!hiZBuffer.init())
+			cout << "Hi-Z culling is not available" << endl;
+		uniformBlocks.init(modelCopies);
+
+		// Low resolution CPU depth buffer for the software occlusion culling
+		softwareRasterizer.init(320, 256, &jobSystem);
+		softwareOccluderAreas.reserve(modelCopies);
+		softwareAABBs.reserve(modelCopies);
+		softwareOccluded.resize(modelCopies);
 	}
 }
 
@@ -115,8 +185,24 @@ bool Scene::loadMesh(const char *filename)
 	if (bSuccess)
 	{
 		meshAABB = mesh->getAABB();
+		// Low polygon version of the mesh for the software occlusion culling
+		meshOccluder.build(*mesh);
+		// Tight bounds of the mesh, and the proxy rendered by the occlusion queries
+		meshProxy.build(*mesh);
+		if (proxyMesh != NULL)
+			delete proxyMesh;
+		proxyMesh = new TriangleMesh();
+		for (const glm::vec3 &v : meshProxy.getVertices())
+			proxyMesh->addVertex(v);
+		for (int t = 0; t < meshProxy.getNumTriangles(); t++)
+			proxyMesh->addTriangle(meshProxy.getTriangles()[3*t], meshProxy.getTriangles()[3*t+1], meshProxy.getTriangles()[3*t+2]);
+		proxyMesh->sendToOpenGL(basicProgram);
 		mesh->sendToOpenGL(basicProgram);
 		mesh->sendToOpenGL(gouraudProgram);
+		if (meshQueueIndex < 0)
+			meshQueueIndex = renderQueue.addMesh(mesh);
+		else
+			renderQueue.setMesh(meshQueueIndex, mesh);
 
 		cube = new TriangleMesh();
 		cube->buildCube();
@@ -131,6 +217,69 @@ bool Scene::loadMesh(const char *filename)
 void Scene::update(int deltaTime)
 {
 	currentTime += deltaTime;
+
+	if (animateInstances && mesh != NULL)
+		moveInstances();
+}
+
+// Move every instance along a small circle around its base position, and update
+// all the structures that depend on the positions
+void Scene::moveInstances()
+{
+	for (int i = 0; i < modelCopies; i++)
+	{
+		float angle = 0.001f * currentTime + glm::radians(rotationAngle[i*3]);
+		positions[i*3]   = basePositions[i*3] + 0.5f * cos(angle);
+		positions[i*3+2] = basePositions[i*3+2] + 0.5f * sin(angle);
+
+		glm::vec3 offset(positions[i*3], positions[i*3+1], positions[i*3+2]);
+		instanceAABBs.setAABB(i, { meshAABB.min + offset, meshAABB.max + offset });
+		instanceBVH.setAABB(i, instanceAABBs.getAABB(i));
+		instanceGrid.move(i, offset);
+	}
+
+	instanceBVH.refit();
+	bvhRebuiltSubtrees = instanceBVH.rebuildDegraded();
+	quadTree.refit(positions, meshAABB, &jobSystem);
+	depthSorter.invalidate();
+	if (gpuCuller.isReady())
+		gpuCuller.update(positions, colors);
+}
+
+// Build the culling structures over the current positions, which also become
+// the positions the animated instances orbit around
+void Scene::buildInstanceStructures()
+{
+	// Instance AABBs for the batched frustum culling
+	instanceAABBs.resize(modelCopies);
+	for (int i = 0; i < modelCopies; i++)
+	{
+		glm::vec3 offset(positions[i*3], positions[i*3+1], positions[i*3+2]);
+		instanceAABBs.setAABB(i, { meshAABB.min + offset, meshAABB.max + offset });
+	}
+	// BVH over the same AABBs, for the hierarchical culling of moving instances
+	instanceBVH.resize(modelCopies);
+	for (int i = 0; i < modelCopies; i++)
+		instanceBVH.setAABB(i, instanceAABBs.getAABB(i));
+	instanceBVH.build();
+	// Hashed grid, the third structure for the hierarchical culling
+	instanceGrid.init(gridCellSize, meshAABB, modelCopies);
+	for (int i = 0; i < modelCopies; i++)
+		instanceGrid.insert(i, glm::vec3(positions[i*3], positions[i*3+1], positions[i*3+2]));
+	std::copy(positions, positions + 3 * modelCopies, basePositions);
+
+	// The quadtree keeps its depth, so the CHC queries still match its nodes
+	quadTree.build(positions, modelCopies, meshAABB, quadTreeDepth, &jobSystem);
+	depthSorter.invalidate();
+}
+
+// Move the instances to another layout, 3 floats per instance, and rebuild everything over them
+void Scene::setInstanceLayout(const float *layout)
+{
+	std::copy(layout, layout + 3 * modelCopies, positions);
+	buildInstanceStructures();
+	if (gpuCuller.isReady())
+		gpuCuller.update(positions, colors);
 }
 
 // Render the scene.
@@ -139,7 +288,7 @@ void Scene::render()
 	// ImGui UI window
 	// Set the next window position using normalized coordinates
     ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_Always, ImVec2(0.0f, 0.0f));
-	ImGui::SetNextWindowSize(ImVec2(280, 460), ImGuiCond_Always);
+	ImGui::SetNextWindowSize(ImVec2(280, 540), ImGuiCond_Always);
 	if (ImGui::Begin("Settings")) {
 		ImGui::Text("Key Commands:");
         ImGui::Text("F1: Toggle application/computer focus");
@@ -148,12 +297,35 @@ void Scene::render()
         ImGui::Separator();
 		ImGui::Text("Frustum Culling");
         ImGui::Checkbox("Enable/Disable Frustum Culling", &viewFrustumCulling);
+		ImGui::RadioButton("Flat", &cullingHierarchy, FLAT_CULLING);
+		ImGui::SameLine();
+		ImGui::RadioButton("Quadtree", &cullingHierarchy, QUADTREE_CULLING);
+		ImGui::RadioButton("BVH", &cullingHierarchy, BVH_CULLING);
+		ImGui::SameLine();
+		ImGui::RadioButton("Grid", &cullingHierarchy, GRID_CULLING);
+		if (cullingHierarchy == GRID_CULLING && ImGui::SliderFloat("Cell size", &gridCellSize, 0.25f, 4.0f) && mesh != NULL)
+		{
+			instanceGrid.init(gridCellSize, meshAABB, modelCopies);
+			for (int i = 0; i < modelCopies; i++)
+				instanceGrid.insert(i, glm::vec3(positions[i*3], positions[i*3+1], positions[i*3+2]));
+		}
+		ImGui::Checkbox("Animate instances", &animateInstances);
+		ImGui::Checkbox("Tight proxies (OBB, 26-DOP)", &tightProxies);
+		ImGui::Checkbox("Front-to-back sorting", &frontToBackSorting);
         ImGui::Separator();
         ImGui::Text("Rendering Technique");
 		ImGui::RadioButton("Default/Simple Rendering", &renderingMode, DEFAULT);
 		ImGui::RadioButton("Occlusion Culling Rendering", &renderingMode, OCCLUSION_CULLING);
+		ImGui::RadioButton("Async Occlusion Culling Rendering", &renderingMode, ASYNC_OCCLUSION_CULLING);
+		ImGui::RadioButton("Conditional Rendering", &renderingMode, CONDITIONAL_RENDERING);
+		ImGui::RadioButton("Instanced Rendering", &renderingMode, INSTANCED_RENDERING);
+		ImGui::RadioButton("GPU Culling Rendering", &renderingMode, GPU_CULLING);
+		ImGui::RadioButton("Hi-Z Culling Rendering", &renderingMode, HIZ_CULLING);
+		ImGui::RadioButton("Software Occlusion Culling", &renderingMode, SOFTWARE_OCCLUSION_CULLING);
+		ImGui::RadioButton("PVS Rendering", &renderingMode, PVS_RENDERING);
 		ImGui::RadioButton("Only AABB Rendering", &renderingMode, ONLY_AABB);
-		//ImGui::RadioButton("CHC Rendering", &renderingMode, CHC); // Under construction...
+		ImGui::RadioButton("CHC Rendering", &renderingMode, CHC);
+		ImGui::RadioButton("CHC++ Rendering", &renderingMode, CHC_PLUS_PLUS);
 		ImGui::Separator();
         ImGui::Text("Debugging Help / AABB Rendering");
 		ImGui::Checkbox("Enable/Disable rendered AABB", &isAABBRendered);
@@ -166,14 +338,105 @@ void Scene::render()
         ImGui::Text("Performance");
 		ImGui::Text("Total models: %d", modelCopies);
 		ImGui::Text("Rendered models: %d", renderedModels);
+		ImGui::Text("Issued queries: %d", issuedQueries);
+		ImGui::Text("GL state calls: %d, redundant skipped: %d", GLState::getIssuedCalls(), GLState::getAvoidedCalls());
+		ImGui::Text("Worker threads: %d", jobSystem.getNumThreads());
+		ImGui::Text("Frustum culling: %.3f ms", cullingTime);
+		ImGui::SliderInt("Min pixels", &contributionThreshold, 0, 400);
+		ImGui::Text("Contribution culled: %d", contributionCulled);
+		if (tightProxies)
+			ImGui::Text("OBB culled: %d, proxy triangles: %d", obbCulled, meshProxy.getNumTriangles());
+		if (frontToBackSorting && (renderingMode == DEFAULT || renderingMode == OCCLUSION_CULLING ||
+			renderingMode == ASYNC_OCCLUSION_CULLING || renderingMode == CONDITIONAL_RENDERING ||
+			renderingMode == INSTANCED_RENDERING))
+			ImGui::Text("Depth sort: %s", depthSortReused ? "reused" : "sorted");
+		if (cullingHierarchy == BVH_CULLING)
+			ImGui::Text("BVH rebuilt subtrees: %d", bvhRebuiltSubtrees);
+		if (cullingHierarchy == GRID_CULLING)
+			ImGui::Text("Grid cells: %d, %d visible", instanceGrid.getNumCells(), instanceGrid.getVisibleCells());
+		if (renderingMode == CONDITIONAL_RENDERING)
+			ImGui::Text("GPU skipped draws: %d", skippedDraws);
 		ImGui::Text("%g fps", sceneFps);
         
     }
     ImGui::End();
 
+	// Parameters of the selected technique
+	if (renderingMode == CHC_PLUS_PLUS || renderingMode == ASYNC_OCCLUSION_CULLING || renderingMode == SOFTWARE_OCCLUSION_CULLING ||
+		renderingMode == PVS_RENDERING || renderingMode == DEFAULT || renderingMode == OCCLUSION_CULLING)
+	{
+		ImGui::SetNextWindowPos(ImVec2(300.0f, 10.0f), ImGuiCond_Always, ImVec2(0.0f, 0.0f));
+		if (ImGui::Begin("Technique Settings", NULL, ImGuiWindowFlags_AlwaysAutoResize)) {
+			if (renderingMode == DEFAULT || renderingMode == OCCLUSION_CULLING)
+			{
+				ImGui::Text("Depth Pre-pass");
+				ImGui::RadioButton("Off", &depthPrePass, NO_DEPTH_PREPASS);
+				ImGui::SameLine();
+				ImGui::RadioButton("Occluders", &depthPrePass, OCCLUDER_DEPTH_PREPASS);
+				ImGui::SameLine();
+				ImGui::RadioButton("All", &depthPrePass, FULL_DEPTH_PREPASS);
+				if (depthPrePass == OCCLUDER_DEPTH_PREPASS)
+					ImGui::SliderInt("Nearest occluders", &prePassOccluders, 1, 64);
+				if (depthPrePass != NO_DEPTH_PREPASS)
+					ImGui::Text("Pre-pass draws: %d", prePassDraws);
+				if (renderingMode == OCCLUSION_CULLING)
+					ImGui::SliderInt("Query batch size", &queryBatchSize, 1, 32);
+				ImGui::Text("Render queue: %d submits, %d program changes", queueSubmits, queueProgramChanges);
+			}
+			if (renderingMode == CHC_PLUS_PLUS)
+			{
+				ImGui::Text("CHC++");
+				ImGui::SliderInt("Visible query interval", &visibleQueryInterval, 1, 20);
+				ImGui::SliderInt("Max batch size", &maxBatchSize, 1, 100);
+			}
+			if (renderingMode == ASYNC_OCCLUSION_CULLING)
+			{
+				ImGui::Text("Async Occlusion Culling");
+				ImGui::SliderInt("Query latency (frames)", &queryLatency, 1, maxQueryLatency);
+			}
+			if (renderingMode == SOFTWARE_OCCLUSION_CULLING)
+			{
+				ImGui::Text("Software Occlusion Culling");
+				ImGui::SliderInt("Occluders", &softwareOccluders, 0, 64);
+				ImGui::Text("Occluder mesh: %d boxes, %d triangles", meshOccluder.getNumBoxes(), meshOccluder.getNumTriangles());
+				ImGui::Text("Depth buffer: %dx%d", softwareRasterizer.getWidth(), softwareRasterizer.getHeight());
+				ImGui::Text("Rasterized triangles: %d", softwareOccluderTriangles);
+				if (cullingHierarchy == GRID_CULLING)
+					ImGui::Text("Occluded grid cells: %d", instanceGrid.getOccludedCells());
+			}
+			if (renderingMode == PVS_RENDERING)
+			{
+				ImGui::Text("PVS");
+				if (!pvs.isReady())
+					ImGui::Text("Not baked");
+				else if (!pvs.isBakedFor(positions, modelCopies))
+					ImGui::Text("Baked for another layout, unused");
+				else if (pvsCell < 0)
+					ImGui::Text("%d cells, camera outside them", pvs.getNumCells());
+				else
+					ImGui::Text("%d cells, camera cell %d: %d visible", pvs.getNumCells(), pvsCell, pvs.getVisibleCount(pvsCell));
+				if (ImGui::Button("Bake PVS"))
+					bakePVS();
+				// The saved layout replaces the random one, so a baked PVS stays valid across runs
+				if (pvs.isReady() && ImGui::Checkbox("Use the PVS layout", &restorePVSLayout))
+					setInstanceLayout(restorePVSLayout ? pvs.getPositions() : randomPositions);
+			}
+		}
+		ImGui::End();
+	}
+
+	// The cache does not know the state left by the ImGui renderer
+	GLState::invalidate();
+	GLState::resetCounters();
+
 	// Mesh rendering
 	if(mesh != NULL)
 	{
+		// Per-instance matrices, computed on the worker threads
+		prepareInstanceConstants();
+		contributionCulled = 0;
+		obbCulled = 0;
+		queueSubmits = queueProgramChanges = 0;
 
 		switch (renderingMode)
 		{
@@ -185,233 +448,995 @@ void Scene::render()
 			// Render the mesh using the Stop and Wait Query Technique
 			renderOcclusionCulling();
 			break;
+		case (ASYNC_OCCLUSION_CULLING):
+			// Render the mesh using the results of the queries of previous frames
+			renderAsyncOcclusionCulling();
+			break;
+		case (CONDITIONAL_RENDERING):
+			// Render the mesh conditionally on its query, without reading it back
+			renderConditional();
+			break;
+		case (INSTANCED_RENDERING):
+			// Render the instances inside the frustum with a single instanced draw
+			renderInstanced();
+			break;
+		case (GPU_CULLING):
+			// Cull and render all the instances on the GPU with a single draw
+			renderGPUCulling();
+			break;
+		case (HIZ_CULLING):
+			// Cull the instances on the GPU against a hierarchical Z-buffer
+			renderHiZCulling();
+			break;
+		case (SOFTWARE_OCCLUSION_CULLING):
+			// Cull the instances against the depth of a few occluders rasterized on the CPU
+			renderSoftwareOcclusionCulling();
+			break;
+		case (PVS_RENDERING):
+			// Render only the potentially visible set of the camera's view cell
+			renderPVS();
+			break;
 		case (ONLY_AABB):
 			// Render the mesh using the Default way
 			renderOnlyAABB();
 			break;
+		case (CHC):
+			// Render the mesh using Coherent Hierarchical Culling over the quadtree
+			renderCHC();
+			break;
+		case (CHC_PLUS_PLUS):
+			// Render the mesh using CHC++ with batched multiqueries
+			renderCHCPlusPlus();
+			break;
 		default:
 			break;
 		}	
+
+		// Leave the default state to the clear of the next frame and to ImGui
+		setDrawState(GL_FILL, true, true);
 	}
 }
 
-// CHC Renderer
-void Scene::renderOnlyAABB()
+// PVS Renderer
+// The potentially visible set of every view cell is baked offline, so at runtime
+// culling is a lookup of the camera's cell, without any query or depth test. The
+// frustum culled instances outside the set are skipped. Outside the baked cells, or
+// when the instances are not where the sets were baked for them, the sets do not
+// apply and only frustum culling is done.
+void Scene::renderPVS()
 {
-	// Rendering loop
-	for (int i=0; i < modelCopies; i++)
+	// Clear the previously rendered model counter
+	renderedModels = 0;
+
+	issuedQueries = 0;
+
+	cullInstances();
+	pvsCell = pvs.isBakedFor(positions, modelCopies) ? pvs.findCell(camera.getPosition()) : -1;
+
+	for (int i : frustumVisibleInstances)
 	{
-		// Adjust the instance's AABB to the mesh AABB
-		calculateInstanceAABB(meshAABB, i);
-		
-		// Check if the model's AABB is inside the view frustum
-		// If not, reset the instance AABB and go to the next one
-		if (viewFrustumCulling && !isAABBInsideFrustum(meshAABB))
+		const AABB aabb = instanceAABBs.getAABB(i);
+		if (pvsCell >= 0 && !pvs.isVisible(pvsCell, i))
 		{
-			// Reset the meshAABB changes for the next model after this iteration break. 
-			resetInstanceAABB(meshAABB, i);
-
+			if (isOcclusionCulled)
+				renderAABBCubeOccluded(aabb.min, aabb.max);
 			continue;
 		}
 
-		// AABB rendering
-		renderAABBCube(meshAABB.min, meshAABB.max);
+		// Toggle the AABB rendering
+		if (isAABBRendered)
+			renderAABBCube(aabb.min, aabb.max);
 
-		// Reset the meshAABB changes for the next model
-		// after properly rendering the model.
-		resetInstanceAABB(meshAABB, i);
-		
+		renderInstance(i);
 	}
 }
 
-// Default Renderer
-void Scene::renderDefault()
+// Bake the potentially visible sets of the current layout, and save them. The view
+// cells are 1x0.3x1 units boxes over the space between the instances, at their
+// height: from higher up the camera sees over them, and the sets hold almost all.
+void Scene::bakePVS()
+{
+	AABB region = { glm::vec3(-6.0f, -0.3f, -4.0f), glm::vec3(6.0f, 0.6f, 12.0f) };
+
+	auto start = std::chrono::steady_clock::now();
+	pvs.bake(positions, modelCopies, meshAABB, meshOccluder, region, glm::ivec3(12, 3, 16), &jobSystem);
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	cout << "PVS of " << pvs.getNumCells() << " cells baked in " << seconds << " s" << endl;
+
+	if (!pvs.save(pvsFilename))
+		cout << "Couldn't save the PVS to " << pvsFilename << endl;
+}
+
+// Software Occlusion Culling Renderer
+// Visibility is decided on the CPU in the current frame, without any query.
+// The simplified occluder meshes of the instances with the largest projected
+// area are rasterized into a low resolution depth buffer, on the worker threads
+// of the SoftwareRasterizer. Then the AABBs of all the candidates are tested against
+// it, and only the ones that are not occluded are rendered.
+void Scene::renderSoftwareOcclusionCulling()
 {
 	// Clear the previously rendered model counter
 	renderedModels = 0;
 
-	// Rendering loop
-	for (int i=0; i < modelCopies; i++)
+	issuedQueries = 0;
+
+	// Frustum culling of the instance AABBs
+	cullInstances();
+	softwareAABBs.clear();
+	for (int i : frustumVisibleInstances)
+		softwareAABBs.push_back(instanceAABBs.getAABB(i));
+
+	// The occluders are the candidates whose occluder mesh covers most of the screen
+	softwareRasterizer.clear(camera.getProjectionMatrix() * camera.getModelViewMatrix());
+	softwareOccluderAreas.clear();
+	for (int i : frustumVisibleInstances)
 	{
-		// Adjust the instance's AABB to the mesh AABB
-		calculateInstanceAABB(meshAABB, i);
-		
-		// Check if the model's AABB is inside the view frustum
-		// If not, reset the instance AABB and go to the next one
-		if (viewFrustumCulling && !isAABBInsideFrustum(meshAABB))
-		{
-			// Reset the meshAABB changes for the next model after this iteration break. 
-			resetInstanceAABB(meshAABB, i);
+		glm::vec3 offset(positions[i*3], positions[i*3+1], positions[i*3+2]);
+		AABB occluderAABB = { meshOccluder.getAABB().min + offset, meshOccluder.getAABB().max + offset };
+		float area = meshOccluder.isEmpty() ? 0.0f : softwareRasterizer.projectedArea(occluderAABB);
+		if (area > 0.0f)
+			softwareOccluderAreas.push_back(std::make_pair(area, i));
+	}
+	int nOccluders = min(softwareOccluders, int(softwareOccluderAreas.size()));
+	std::partial_sort(softwareOccluderAreas.begin(), softwareOccluderAreas.begin() + nOccluders, softwareOccluderAreas.end(),
+		std::greater<std::pair<float, int>>());
+
+	for (int o = 0; o < nOccluders; ++o)
+	{
+		int i = softwareOccluderAreas[o].second;
+		softwareRasterizer.addOccluder(meshOccluder.getVertices(), meshOccluder.getTriangles(), glm::vec3(positions[i*3], positions[i*3+1], positions[i*3+2]));
+	}
+	softwareRasterizer.rasterize();
+	softwareOccluderTriangles = softwareRasterizer.getRasterizedTriangles();
+
+	// With the grid, the cells of the candidates are tested against the occluders
+	// first, and the instances of the occluded ones are dropped without testing them
+	if (viewFrustumCulling && cullingHierarchy == GRID_CULLING)
+	{
+		instanceGrid.removeOccluded(frustumVisibleInstances,
+			[this](const AABB &aabb) { return softwareRasterizer.isOccluded(aabb); });
+		softwareAABBs.clear();
+		for (int i : frustumVisibleInstances)
+			softwareAABBs.push_back(instanceAABBs.getAABB(i));
+	}
 
+	softwareRasterizer.testAABBs(softwareAABBs.data(), int(softwareAABBs.size()), softwareOccluded.data());
+
+	for (std::size_t c = 0; c < frustumVisibleInstances.size(); ++c)
+	{
+		const AABB &aabb = softwareAABBs[c];
+		if (softwareOccluded[c])
+		{
+			if (isOcclusionCulled)
+				renderAABBCubeOccluded(aabb.min, aabb.max);
 			continue;
 		}
 
-		// Toggle the AABB rendering
+		// Toggle the AABB rendering of rendered meshes
 		if (isAABBRendered)
+			renderAABBCube(aabb.min, aabb.max);
+
+		renderInstance(frustumVisibleInstances[c]);
+	}
+}
+
+
+// CHC Renderer
+void Scene::renderOnlyAABB()
+{
+	// Rendering loop over the instances inside the frustum
+	cullInstances();
+	for (int i : frustumVisibleInstances)
+	{
+		// Instance AABB
+		const AABB aabb = instanceAABBs.getAABB(i);
+
+		// AABB rendering
+		renderAABBCube(aabb.min, aabb.max);
+	}
+}
+
+// Default Renderer
+void Scene::renderDefault()
+{
+	// Clear the previously rendered model counter
+	renderedModels = 0;
+
+	// Queue the instances inside the frustum, then draw them all
+	cullInstances();
+	sortInstances();
+	renderDepthPrePass();
+	renderQueue.clear();
+	for (int i : frustumVisibleInstances)
+		queueInstance(i);
+	submitRenderQueue();
+
+	// Toggle the AABB rendering, after the shading pass so that the boxes are depth tested normally
+	if (isAABBRendered)
+	{
+		for (int i : frustumVisibleInstances)
 		{
 			// Render the AABB
-			renderAABBCube(meshAABB.min, meshAABB.max);
+			const AABB aabb = instanceAABBs.getAABB(i);
+			renderAABBCube(aabb.min, aabb.max);
 		}
+	}
+}
+
+// Depth Pre-pass
+// Render the depth of the first prePassOccluders instances of frustumVisibleInstances,
+// the nearest ones when sorted, or of all of them, with the color writes disabled.
+// Then select the depth test of the shading pass: the fragments of the instances in
+// the pre-pass have the same depth, so GL_EQUAL shades only the front ones when all
+// of them are in, and GL_LEQUAL keeps testing the others normally.
+void Scene::renderDepthPrePass()
+{
+	prePassDraws = 0;
+	shadingDepthFunc = GL_LESS;
+	if (depthPrePass == NO_DEPTH_PREPASS)
+		return;
+
+	int count = int(frustumVisibleInstances.size());
+	if (depthPrePass == OCCLUDER_DEPTH_PREPASS)
+		count = std::min(count, prePassOccluders);
+
+	depthProgram.use();
+	setDrawState(GL_FILL, false, true);
+	for (int k = 0; k < count; k++)
+	{
+		depthProgram.setUniform(depthUniforms.instance, frustumVisibleInstances[k]);
+		mesh->render();
+		prePassDraws++;
+	}
+
+	shadingDepthFunc = (depthPrePass == FULL_DEPTH_PREPASS) ? GL_EQUAL : GL_LEQUAL;
+}
 
-		// Render the mesh
-		// Compute  model matrix and i-related parameters (i.e., color)
-		model = glm::translate(glm::mat4(1.0), glm::vec3(positions[i*3], positions[i*3+1], positions[i*3+2]));
-		modelview = camera.getModelViewMatrix() * model;
-		normalMatrix = glm::inverseTranspose(camera.getModelViewMatrix());
+// Occlusion Culling Renderer
+void Scene::renderOcclusionCulling()
+{
 
-		// Select rendering shader
-		switch (shaderMode)
+	// Clear the previously rendered model counter
+	renderedModels = 0;
+
+	issuedQueries = 0;
+
+	cullInstances();
+	sortInstances();
+	renderDepthPrePass();
+
+	// The queries of a batch are issued together, and waited for together. They
+	// test against the instances of the batches before, which are nearer.
+	int count = int(frustumVisibleInstances.size());
+	for (int first = 0; first < count; first += queryBatchSize)
+	{
+		int last = std::min(count, first + queryBatchSize);
+		for (int k = first; k < last; k++)
 		{
-			case (PHONG):
-				basicProgram.use();
-				basicProgram.setUniformMatrix4f("projection", camera.getProjectionMatrix());
-				basicProgram.setUniform4f("color", colors[i*3], colors[i*3+1], colors[i*3+2], 1.0f);
-				basicProgram.setUniformMatrix4f("modelview", modelview);
-				basicProgram.setUniformMatrix3f("normalMatrix", normalMatrix);
-				mesh->render();
-				break;
-			case (GOURAUD):
-				gouraudProgram.use();
-				gouraudProgram.setUniformMatrix4f("projection", camera.getProjectionMatrix());
-				gouraudProgram.setUniformMatrix4f("modelview", modelview);
-				gouraudProgram.setUniformMatrix3f("normalMatrix", normalMatrix);
-				mesh->render();
-				break;
-			default:
-				break;
+			// Occlusion Querying
+			Query query = stopAndWaitQueries.getQuery(frustumVisibleInstances[k]);
+			issuedQueries++;
+			query.begin();
+			// Render the proxy
+			renderInstanceProxy(frustumVisibleInstances[k]);
+			query.end();
 		}
 
-		// Update the rendered model counter
-		renderedModels++;
+		renderQueue.clear();
+		for (int k = first; k < last; k++)
+		{
+			int i = frustumVisibleInstances[k];
+			const AABB aabb = instanceAABBs.getAABB(i);
+
+			// Render if we 've got the query result. The proxy is clipped by the near
+			// plane when the camera is inside it, so then the instance is always visible.
+			if (isQueryVisible(stopAndWaitQueries.getQuery(i)) || isCameraInsideAABB(aabb)) {
+
+				// Toggle the AABB rendering of rendered meshes
+				if (isAABBRendered)
+				{
+					// Render the AABB
+					renderAABBCube(aabb.min, aabb.max);
+				}
 
-		// Reset the meshAABB changes for the next model
-		// after properly rendering the model.
-		resetInstanceAABB(meshAABB, i);
-		
+				queueInstance(i);
+			}
+			else
+			{
+				if(isOcclusionCulled)
+					renderAABBCubeOccluded(aabb.min, aabb.max);
+			}
+		}
+		submitRenderQueue();
 	}
 }
 
-// Occlusion Culling Renderer
-void Scene::renderOcclusionCulling()
+
+// Asynchronous Occlusion Culling Renderer
+// Instead of waiting for the query issued in the current frame, each instance
+// uses the result of its query from queryLatency frames ago. Results that are
+// still pending, or missing, are treated as visible. Visible instances are
+// queried with their own mesh, and invisible ones with their proxy.
+void Scene::renderAsyncOcclusionCulling()
 {
+	// Clear the previously rendered model counter
+	renderedModels = 0;
 
+	issuedQueries = 0;
+	currentFrame++;
+	asyncQueries.nextFrame();
+
+	cullInstances();
+	sortInstances();
+	for (int i : frustumVisibleInstances)
+	{
+		// Instance AABB
+		const AABB aabb = instanceAABBs.getAABB(i);
+
+		// Fetch the result of the query issued queryLatency frames ago, if it is ready
+		bool visible = true;
+		if (asyncQueries.wasIssued(i, queryLatency))
+		{
+			Query previousQuery = asyncQueries.getQuery(i, queryLatency);
+			if (previousQuery.resultIsReady())
+				visible = isQueryVisible(previousQuery);
+		}
+		// The proxy is clipped by the near plane when the camera is inside it, so
+		// its query passes no samples, yet the instance is always visible
+		visible = visible || isCameraInsideAABB(aabb);
+
+		// Toggle the AABB rendering of rendered meshes
+		if (visible && isAABBRendered)
+			renderAABBCube(aabb.min, aabb.max);
+
+		// Query the visibility for a later frame
+		Query query = asyncQueries.getQuery(i);
+		issuedQueries++;
+
+		query.begin();
+		if (visible)
+			renderInstance(i);
+		else
+			renderInstanceProxy(i);
+		query.end();
+
+		if (!visible && isOcclusionCulled)
+			renderAABBCubeOccluded(aabb.min, aabb.max);
+	}
+}
+
+
+// Conditional Renderer
+// Each draw is wrapped in a conditional render on the query of the instance's
+// proxy, so the GPU itself skips the occluded instances and the CPU never reads
+// the queries back. The only readback is the per-frame statistics query, which
+// is consumed once it is ready, maxQueryLatency frames later.
+void Scene::renderConditional()
+{
 	// Clear the previously rendered model counter
 	renderedModels = 0;
 
-	// Initialize the queries
-	// Below is a workaround of not being allowed to declare QueryPool queryPool in Scene.h
-	// so I declare it in Scene::init and pass it through this workaround
-	QueryPool qpStopAndWait;
-	qpStopAndWait = qp[0];
+	issuedQueries = 0;
+	currentFrame++;
+	statisticsQueries.nextFrame();
 
-    Query query = qpStopAndWait.getQuery();
+	// Primitives of the oldest frame in flight, minus those of the proxies and cubes,
+	// give the number of draws the GPU actually executed
+	if (statisticsQueries.wasIssued(0, maxQueryLatency))
+	{
+		Query previousStatistics = statisticsQueries.getQuery(0, maxQueryLatency);
+		if (previousStatistics.resultIsReady())
+		{
+			int previousSlot = statisticsQueries.ringFrame(maxQueryLatency);
+			int meshPrimitives = previousStatistics.result() - conditionalProxyTriangles[previousSlot];
+			int primitivesPerDraw = mesh->getNumVertices() / 3;
+			skippedDraws = conditionalDraws[previousSlot] - (meshPrimitives + primitivesPerDraw / 2) / primitivesPerDraw;
+		}
+	}
 
-    for (int i = 0; i < modelCopies; ++i) {
-        
-		// Adjust the instance's AABB to the mesh AABB
-		calculateInstanceAABB(meshAABB, i);
-		
-		// Check if the model's AABB is inside the view frustum
-		// If not, reset the instance AABB and go to the next one
-		if (viewFrustumCulling && !isAABBInsideFrustum(meshAABB))
+	// The counters of a frame live in the slot of its statistics query, so that
+	// other modes advancing currentFrame do not misalign them
+	int slot = statisticsQueries.ringFrame();
+	conditionalDraws[slot] = 0;
+	conditionalProxyTriangles[slot] = 0;
+
+	Query statistics = statisticsQueries.getQuery(0);
+	statistics.begin();
+	cullInstances();
+	sortInstances();
+	for (int i : frustumVisibleInstances)
+	{
+		// Instance AABB
+		const AABB aabb = instanceAABBs.getAABB(i);
+
+		// Toggle the AABB rendering
+		if (isAABBRendered)
 		{
-			// Reset the meshAABB changes for the next model after this iteration break. 
-			resetInstanceAABB(meshAABB, i);
+			renderAABBCube(aabb.min, aabb.max);
+			conditionalProxyTriangles[slot] += cube->getNumVertices() / 3;
+		}
 
+		// The proxy is clipped by the near plane when the camera is inside it, so its
+		// query would fail. The instance is always visible then, and drawn as is.
+		if (isCameraInsideAABB(aabb))
+		{
+			renderInstance(i);
+			conditionalDraws[slot]++;
 			continue;
 		}
-		
+
 		// Occlusion Querying
+		Query query = conditionalQueries.getQuery(i);
+		issuedQueries++;
 		query.begin();
-		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-		glDepthMask(GL_FALSE);
-		// Render the AABB
-		renderAABBCube(meshAABB.min, meshAABB.max);
-		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-		glDepthMask(GL_TRUE);
+		renderInstanceProxy(i);
 		query.end();
+		conditionalProxyTriangles[slot] += (tightProxies ? proxyMesh : cube)->getNumVertices() / 3;
+
+		// Render the mesh only if the query passes
+		query.beginConditionalRender(GL_QUERY_NO_WAIT);
+		renderInstance(i);
+		query.endConditionalRender();
+		conditionalDraws[slot]++;
+	}
+	statistics.end();
+}
 
-		// Render if we 've got the query result
-		if (query.isVisible() > 0) {
 
-			// Toggle the AABB rendering of rendered meshes
-			if (isAABBRendered)
+// Instanced Renderer
+// The instances that pass the frustum culling, in front-to-back order, are compacted
+// into the instance buffer of the InstancedRenderer, and drawn with a single
+// glDrawArraysInstanced instead of one draw and its uniforms per instance.
+void Scene::renderInstanced()
+{
+	// Fall back to the default renderer without instanced attribute support
+	if (!instancedRenderer.isReady())
+	{
+		renderDefault();
+		return;
+	}
+
+	issuedQueries = 0;
+
+	cullInstances();
+	sortInstances();
+	instancedRenderer.update(frustumVisibleInstances, instanceModels, colors);
+	setDrawState(GL_FILL, true, true);
+	instancedRenderer.render(camera.getProjectionMatrix(), camera.getModelViewMatrix());
+	renderedModels = instancedRenderer.getNumInstances();
+
+	// Toggle the AABB rendering
+	if (isAABBRendered)
+	{
+		for (int i : frustumVisibleInstances)
+		{
+			const AABB aabb = instanceAABBs.getAABB(i);
+			renderAABBCube(aabb.min, aabb.max);
+		}
+	}
+}
+
+
+// GPU Culling Renderer
+// Frustum culling runs in a compute shader, which compacts the visible instances
+// and writes the indirect draw command. The CPU cost does not depend on modelCopies.
+void Scene::renderGPUCulling()
+{
+	// Fall back to the default renderer without compute shader support
+	if (!gpuCuller.isReady())
+	{
+		renderDefault();
+		return;
+	}
+
+	issuedQueries = 0;
+
+	gpuCuller.beginFrame();
+	gpuCuller.cull(camera.getFrustum(), viewFrustumCulling);
+	setDrawState(GL_FILL, true, true);
+	gpuCuller.render(camera.getProjectionMatrix(), camera.getModelViewMatrix());
+
+	// The visible instance count is read back a few frames late
+	renderedModels = gpuCuller.getVisibleInstances();
+}
+
+
+// Hi-Z Culling Renderer
+// Occlusion culling without queries. The instances visible in the last frame are
+// drawn first, and a hierarchical Z-buffer is built from the resulting depth.
+// Then every instance is tested against it: this updates the visibility for the
+// next frame, and the disoccluded instances, which were hidden in the last frame
+// but are visible now, are drawn in a second indirect draw.
+void Scene::renderHiZCulling()
+{
+	// Fall back to the default renderer without compute shader support
+	if (!gpuCuller.isReady() || !hiZBuffer.isReady())
+	{
+		renderDefault();
+		return;
+	}
+
+	issuedQueries = 0;
+
+	glm::mat4 viewProjection = camera.getProjectionMatrix() * camera.getModelViewMatrix();
+
+	gpuCuller.beginFrame();
+	gpuCuller.cull(camera.getFrustum(), viewFrustumCulling, GPUCuller::PREVIOUSLY_VISIBLE);
+	setDrawState(GL_FILL, true, true);
+	gpuCuller.render(camera.getProjectionMatrix(), camera.getModelViewMatrix(), 0);
+
+	hiZBuffer.build();
+
+	gpuCuller.cull(camera.getFrustum(), viewFrustumCulling, GPUCuller::OCCLUSION, &hiZBuffer, viewProjection);
+	gpuCuller.render(camera.getProjectionMatrix(), camera.getModelViewMatrix(), 1);
+
+	// The visible instance count is read back a few frames late
+	renderedModels = gpuCuller.getVisibleInstances();
+}
+
+
+// CHC Renderer
+// Coherent Hierarchical Culling (Bittner et al. 2004): the quadtree is traversed
+// front to back, and queries are only issued for previously invisible nodes and
+// previously visible leaves. Previously visible leaves are rendered right away
+// without waiting for their query, which is only used to update their visibility.
+void Scene::renderCHC()
+{
+	// Clear the previously rendered model counter
+	renderedModels = 0;
+
+	issuedQueries = 0;
+	currentFrame++;
+	chcQueries.clear();
+
+	traversalStack.push(quadTree.root());
+	while (!traversalStack.empty() || !queryQueue.empty())
+	{
+		// Process the finished queries. Only block on a query
+		// when there is nothing left to traverse
+		while (!queryQueue.empty() &&
+			(queryQueue.front().query.resultIsReady() || traversalStack.empty()))
+		{
+			CHCQuery entry = queryQueue.front();
+			queryQueue.pop();
+
+			if (isQueryVisible(entry.query))
 			{
-				// Render the AABB
-				renderAABBCube(meshAABB.min, meshAABB.max);
+				// Previously visible nodes have already been traversed
+				if (!entry.wasVisible)
+					traverseNode(entry.node);
+				pullUpVisibility(entry.node);
 			}
+			else if (isOcclusionCulled)
+				renderQuadTreeLeafOccluded(entry.node);
+		}
+
+		// Hierarchical traversal
+		if (!traversalStack.empty())
+		{
+			QuadTreeNodeIndex node = traversalStack.top();
+			traversalStack.pop();
 
-			// Render the mesh
-			// Compute  model matrix and i-related parameters (i.e., color)
-			model = glm::translate(glm::mat4(1.0), glm::vec3(positions[i*3], positions[i*3+1], positions[i*3+2]));
-			modelview = camera.getModelViewMatrix() * model;
-			normalMatrix = glm::inverseTranspose(camera.getModelViewMatrix());
-			
-			// Select rendering shader
-			switch (shaderMode)
+			QuadTreeNode &n = quadTree.nodes[node];
+			if (quadTree.isEmpty(node) || (viewFrustumCulling && !isAABBInsideFrustum(n.aabb)))
+				continue;
+
+			// The camera can not be occluded from a node that contains it
+			if (isCameraInsideAABB(n.aabb))
 			{
-				case (PHONG):
-					basicProgram.use();
-					basicProgram.setUniform4f("color", colors[i*3], colors[i*3+1], colors[i*3+2], 1.0f);
-					basicProgram.setUniformMatrix4f("modelview", modelview);
-					basicProgram.setUniformMatrix3f("normalMatrix", normalMatrix);
-					mesh->render();
-					break;
-				case (GOURAUD):
-					gouraudProgram.use();
-					gouraudProgram.setUniformMatrix4f("modelview", modelview);
-					gouraudProgram.setUniformMatrix3f("normalMatrix", normalMatrix);
-					mesh->render();
-					break;
-				default:
-					break;
+				n.visible = true;
+				n.lastVisited = currentFrame;
+				traverseNode(node);
+				continue;
 			}
 
-			// Update the rendered model counter
-			renderedModels++;
+			// Identify the previously visible nodes
+			bool wasVisible = n.visible && (n.lastVisited == currentFrame - 1);
+
+			// Reset the visibility flag of the nodes we are going to query
+			n.visible = false;
+			n.lastVisited = currentFrame;
+
+			// Previously visible interior nodes are opened without a query.
+			// Their visibility is pulled up from their children
+			if (!wasVisible || quadTree.isLeaf(node))
+				issueOcclusionQuery(node, wasVisible);
+
+			// Traverse the previously visible nodes
+			if (wasVisible)
+				traverseNode(node);
 		}
-		else
+	}
+}
+
+// Render a leaf, or push the children of an interior node front to back
+void Scene::traverseNode(QuadTreeNodeIndex node)
+{
+	if (quadTree.isLeaf(node))
+	{
+		renderQuadTreeLeaf(node);
+		return;
+	}
+
+	// Sort the children by distance to the camera, and push the
+	// farthest first so that the nearest is popped first
+	const glm::vec3 &eye = camera.getPosition();
+	std::pair<float, QuadTreeNodeIndex> children[4];
+	for (int c = 0; c < 4; c++)
+	{
+		QuadTreeNodeIndex child = quadTree.child(node, c);
+		const AABB &aabb = quadTree.nodes[child].aabb;
+		glm::vec3 closestPoint = glm::clamp(eye, aabb.min, aabb.max);
+		children[c] = std::make_pair(glm::dot(closestPoint - eye, closestPoint - eye), child);
+	}
+	std::sort(children, children + 4);
+	for (int c = 3; c >= 0; c--)
+		traversalStack.push(children[c].second);
+}
+
+// Mark the node and its ancestors as visible
+void Scene::pullUpVisibility(QuadTreeNodeIndex node)
+{
+	while (!quadTree.nodes[node].visible)
+	{
+		quadTree.nodes[node].visible = true;
+		if (!quadTree.hasParent(node))
+			break;
+		node = quadTree.parent(node);
+	}
+}
+
+// Render the node's bounding box against the current depth buffer
+void Scene::issueOcclusionQuery(QuadTreeNodeIndex node, bool wasVisible)
+{
+	Query query = chcQueries.getQuery();
+	issuedQueries++;
+
+	query.begin();
+	renderNodeProxy(node);
+	query.end();
+
+	queryQueue.push({node, query, wasVisible});
+}
+
+// Render the instances of a quadtree leaf
+void Scene::renderQuadTreeLeaf(QuadTreeNodeIndex node)
+{
+	const QuadTreeNode &n = quadTree.nodes[node];
+	for (int k = n.begin; k < n.end; k++)
+	{
+		int i = quadTree.instances[k];
+		const AABB aabb = instanceAABBs.getAABB(i);
+
+		// The leaf may be only partially inside the view frustum
+		if (!viewFrustumCulling || isInstanceInsideFrustum(i))
 		{
-			if(isOcclusionCulled)
-				renderAABBCubeOccluded(meshAABB.min, meshAABB.max);
+			// Toggle the AABB rendering
+			if (isAABBRendered)
+				renderAABBCube(aabb.min, aabb.max);
+
+			renderInstance(i);
 		}
-        
-		// Reset the meshAABB changes for the next model after this iteration break. 
-		resetInstanceAABB(meshAABB, i);
-    }
+	}
 }
 
+// Render the AABBs of the instances of an occluded leaf
+void Scene::renderQuadTreeLeafOccluded(QuadTreeNodeIndex node)
+{
+	if (!quadTree.isLeaf(node))
+		return;
 
-// CHC Renderer
-void Scene::renderCHC()
+	const QuadTreeNode &n = quadTree.nodes[node];
+	for (int k = n.begin; k < n.end; k++)
+	{
+		const AABB aabb = instanceAABBs.getAABB(quadTree.instances[k]);
+		renderAABBCubeOccluded(aabb.min, aabb.max);
+	}
+}
+
+// CHC++ Renderer
+// CHC++ (Mattausch et al. 2008) reduces the number of queries of CHC:
+// - Previously invisible nodes are batched, and tested with multiqueries that render
+//   the boxes of several nodes at once. The batches are built with a cost model
+//   based on how long the nodes have been invisible.
+// - Previously visible leaves are assumed visible for a randomized number of frames,
+//   and their queries are only issued while waiting for other query results.
+void Scene::renderCHCPlusPlus()
 {
+	// Clear the previously rendered model counter
+	renderedModels = 0;
 
+	issuedQueries = 0;
+	currentFrame++;
+	chcQueries.clear();
+	multiQueryNodes.clear();
+
+	distanceQueue.push(DistanceEntry(0.0f, quadTree.root()));
+	while (!distanceQueue.empty() || !multiQueryQueue.empty())
+	{
+		// Process the finished queries. While waiting for them,
+		// issue the queries of the previously visible leaves
+		while (!multiQueryQueue.empty())
+		{
+			if (multiQueryQueue.front().query.resultIsReady() ||
+				(distanceQueue.empty() && visibleQueue.empty()))
+			{
+				CHCMultiQuery entry = multiQueryQueue.front();
+				multiQueryQueue.pop();
+				handleReturnedQuery(entry);
+			}
+			else if (!visibleQueue.empty())
+			{
+				multiQueryNodes.push_back(visibleQueue.front());
+				visibleQueue.pop();
+				issueMultiQuery(multiQueryNodes.size() - 1, multiQueryNodes.size(), true);
+			}
+			else
+				break;
+		}
+
+		// Hierarchical traversal
+		if (!distanceQueue.empty())
+		{
+			QuadTreeNodeIndex node = distanceQueue.top().second;
+			distanceQueue.pop();
+
+			QuadTreeNode &n = quadTree.nodes[node];
+			if (!quadTree.isEmpty(node) && (!viewFrustumCulling || isAABBInsideFrustum(n.aabb)))
+			{
+				bool wasVisible = n.visible && (n.lastVisited == currentFrame - 1);
+				n.lastVisited = currentFrame;
+
+				if (isCameraInsideAABB(n.aabb))
+				{
+					// The camera can not be occluded from a node that contains it
+					n.visible = true;
+					traverseNodeCHCPlusPlus(node);
+				}
+				else if (!wasVisible)
+				{
+					n.visible = false;
+					queryPreviouslyInvisibleNode(node);
+				}
+				else
+				{
+					// Interior nodes get their visibility pulled up from their children,
+					// and leaves are only queried once their visible interval expires
+					n.visible = false;
+					if (quadTree.isLeaf(node))
+					{
+						if (currentFrame >= n.nextQueryFrame)
+							visibleQueue.push(node);
+						else
+							pullUpVisibility(node);
+					}
+					traverseNodeCHCPlusPlus(node);
+				}
+			}
+		}
+
+		// Flush the batched invisible nodes when the traversal runs out of nodes
+		if (distanceQueue.empty())
+			issueMultiQueries();
+	}
+
+	// Query the remaining previously visible leaves, and wait for their results
+	while (!visibleQueue.empty())
+	{
+		multiQueryNodes.push_back(visibleQueue.front());
+		visibleQueue.pop();
+		issueMultiQuery(multiQueryNodes.size() - 1, multiQueryNodes.size(), true);
+	}
+	while (!multiQueryQueue.empty())
+	{
+		CHCMultiQuery entry = multiQueryQueue.front();
+		multiQueryQueue.pop();
+		handleReturnedQuery(entry);
+	}
 }
-           
 
-// Calculate the AABB for each model
-void Scene::calculateInstanceAABB(AABB& aabb, int i)
+// Render a leaf, or push the children of an interior node into the distance queue
+void Scene::traverseNodeCHCPlusPlus(QuadTreeNodeIndex node)
+{
+	if (quadTree.isLeaf(node))
+	{
+		renderQuadTreeLeaf(node);
+		return;
+	}
+
+	const glm::vec3 &eye = camera.getPosition();
+	for (int c = 0; c < 4; c++)
+	{
+		QuadTreeNodeIndex child = quadTree.child(node, c);
+		const AABB &aabb = quadTree.nodes[child].aabb;
+		glm::vec3 closestPoint = glm::clamp(eye, aabb.min, aabb.max);
+		distanceQueue.push(DistanceEntry(glm::dot(closestPoint - eye, closestPoint - eye), child));
+	}
+}
+
+// Batch a previously invisible node for the next multiqueries
+void Scene::queryPreviouslyInvisibleNode(QuadTreeNodeIndex node)
+{
+	invisibleQueue.push_back(node);
+	if ((int)invisibleQueue.size() >= maxBatchSize)
+		issueMultiQueries();
+}
+
+// Probability that a node which has been invisible for the given
+// number of frames stays invisible in the current frame
+static float stayInvisibleProbability(unsigned int invisibleFrames)
+{
+	return 0.99f - 0.7f * std::exp(-float(invisibleFrames));
+}
+
+// Group the batched invisible nodes into multiqueries. A group grows while
+// the expected number of nodes resolved per query keeps increasing, taking
+// into account that a failed multiquery must be repeated for every node.
+void Scene::issueMultiQueries()
+{
+	// Nodes that have been invisible for longer are grouped first
+	std::sort(invisibleQueue.begin(), invisibleQueue.end(),
+		[this](QuadTreeNodeIndex a, QuadTreeNodeIndex b)
+		{
+			return quadTree.nodes[a].invisibleFrames > quadTree.nodes[b].invisibleFrames;
+		});
+
+	std::size_t i = 0;
+	while (i < invisibleQueue.size())
+	{
+		int begin = multiQueryNodes.size();
+		float pInvisible = 1.0f;
+		float bestValue = 0.0f;
+
+		for (; i < invisibleQueue.size(); i++)
+		{
+			float p = pInvisible * stayInvisibleProbability(quadTree.nodes[invisibleQueue[i]].invisibleFrames);
+			float n = float(multiQueryNodes.size() - begin + 1);
+			float value = n / (1.0f + (1.0f - p) * n);
+			if (n > 1.0f && value <= bestValue)
+				break;
+
+			bestValue = value;
+			pInvisible = p;
+			multiQueryNodes.push_back(invisibleQueue[i]);
+		}
+
+		issueMultiQuery(begin, multiQueryNodes.size(), false);
+	}
+
+	invisibleQueue.clear();
+}
+
+// Render the boxes of the nodes in the [begin, end) range of multiQueryNodes in one query
+void Scene::issueMultiQuery(int begin, int end, bool wasVisible)
 {
-    aabb.min.x += positions[i*3];
-	aabb.min.y += positions[i*3 + 1];
-	aabb.min.z += positions[i*3 + 2];
+	Query query = chcQueries.getQuery();
+	issuedQueries++;
 
-	aabb.max.x += positions[i*3];
-	aabb.max.y += positions[i*3 + 1];
-	aabb.max.z += positions[i*3 + 2];
+	query.begin();
+	for (int k = begin; k < end; k++)
+		renderNodeProxy(multiQueryNodes[k]);
+	query.end();
+
+	multiQueryQueue.push({begin, end, query, wasVisible});
 }
 
-// Reset the AABB for each model
-void Scene::resetInstanceAABB(AABB& aabb, int i)
+// Update the visibility of the nodes of a finished CHC++ query
+void Scene::handleReturnedQuery(const CHCMultiQuery& entry)
 {
-	aabb.min.x -= positions[i*3];
-	aabb.min.y -= positions[i*3 + 1];
-	aabb.min.z -= positions[i*3 + 2];
+	if (!isQueryVisible(entry.query))
+	{
+		for (int k = entry.begin; k < entry.end; k++)
+		{
+			quadTree.nodes[multiQueryNodes[k]].invisibleFrames++;
+			if (isOcclusionCulled)
+				renderQuadTreeLeafOccluded(multiQueryNodes[k]);
+		}
+		return;
+	}
+
+	// Some node of a failed multiquery is visible: query them one by one
+	if (entry.end - entry.begin > 1)
+	{
+		for (int k = entry.begin; k < entry.end; k++)
+			issueMultiQuery(k, k + 1, entry.wasVisible);
+		return;
+	}
+
+	// Visible nodes are assumed visible for a randomized number of frames,
+	// which spreads their queries over time
+	QuadTreeNodeIndex node = multiQueryNodes[entry.begin];
+	quadTree.nodes[node].invisibleFrames = 0;
+	quadTree.nodes[node].nextQueryFrame = currentFrame + 1 + randomGenerator() % visibleQueryInterval;
+
+	if (!entry.wasVisible)
+		traverseNodeCHCPlusPlus(node);
+	pullUpVisibility(node);
+}
 
-	aabb.max.x -= positions[i*3];
-	aabb.max.y -= positions[i*3 + 1];
-	aabb.max.z -= positions[i*3 + 2];
+// Compute the model and modelview matrices of every instance for the current frame,
+// in parallel, and upload them with the camera to the uniform blocks, so that the
+// rendering loops only select the instance. Instances are only translated, so they
+// all share the normal matrix of the camera.
+void Scene::prepareInstanceConstants()
+{
+	const glm::mat4 &view = camera.getModelViewMatrix();
+	normalMatrix = glm::inverseTranspose(glm::mat3(view));
+
+	jobSystem.parallelFor(modelCopies, 64, [this, &view](int, int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			instanceModels[i] = getInstanceModel(i);
+			instanceModelviews[i] = view * instanceModels[i];
+		}
+	});
+
+	uniformBlocks.updateFrame(camera.getProjectionMatrix(), view, normalMatrix);
+	uniformBlocks.updateInstances(instanceModelviews, colors);
+}
+
+// Model matrix of an instance, the only place that places it in the scene
+glm::mat4 Scene::getInstanceModel(int i)
+{
+	return glm::translate(glm::mat4(1.0f), glm::vec3(positions[i*3], positions[i*3+1], positions[i*3+2]));
+}
+
+// Render a single instance of the mesh with the selected shader
+void Scene::renderInstance(int i)
+{
+	// The matrices and color of the instance were uploaded by prepareInstanceConstants,
+	// the shaders only need its index
+	setDrawState(GL_FILL, true, true);
+
+	// Select rendering shader
+	switch (shaderMode)
+	{
+		case (PHONG):
+			basicProgram.use();
+			basicProgram.setUniform(basicUniforms.instance, i);
+			mesh->render();
+			break;
+		case (GOURAUD):
+			gouraudProgram.use();
+			gouraudProgram.setUniform(gouraudUniforms.instance, i);
+			mesh->render();
+			break;
+		default:
+			break;
+	}
+
+	// Update the rendered model counter
+	renderedModels++;
+}
+
+// Add a draw of an instance with the program of the selected shader to the render queue
+void Scene::queueInstance(int i)
+{
+	float depth = -instanceModelviews[i][3][2];
+	renderQueue.push(shadingQueuePrograms[shaderMode], meshQueueIndex, i, depth);
+}
+
+// Draw the queued instances, with the depth test of the shading pass
+void Scene::submitRenderQueue()
+{
+	renderQueue.sort();
+	setDrawState(GL_FILL, true, true);
+	glDepthFunc(shadingDepthFunc);
+	renderedModels += renderQueue.submit();
+	glDepthFunc(GL_LESS);
+
+	queueSubmits++;
+	queueProgramChanges += renderQueue.getProgramChanges();
+}
+
+void Scene::setDrawState(GLenum polygonMode, bool colorWrite, bool depthWrite)
+{
+	GLState::polygonMode(polygonMode);
+	GLState::colorMask(colorWrite);
+	GLState::depthMask(depthWrite);
 }
+           
 
 // Helper function to render the AABB cube
 void Scene::renderAABBCube(const glm::vec3& minPoint, const glm::vec3& maxPoint)
@@ -428,11 +1453,11 @@ void Scene::renderAABBCube(const glm::vec3& minPoint, const glm::vec3& maxPoint)
 	modelview = camera.getModelViewMatrix() * modelCube;
     
 	// Rendering as wireframe
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    basicProgram.setUniform4f("color", 0.0f, 1.0f, 0.0f, 1.0f);		// Set the color to green
-    basicProgram.setUniformMatrix4f("modelview", modelview);
+	setDrawState(GL_LINE, true, true);
+	boxProgram.use();
+    boxProgram.setUniform(boxUniforms.color, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));		// Set the color to green
+    boxProgram.setUniform(boxUniforms.modelview, modelview);
     cube->render();
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
 // Helper function to render the AABB cube
@@ -450,55 +1475,254 @@ void Scene::renderAABBCubeOccluded(const glm::vec3& minPoint, const glm::vec3& m
 	modelview = camera.getModelViewMatrix() * modelCube;
     
 	// Rendering as wireframe
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    basicProgram.setUniform4f("color", 0.8f, 0.8f, 0.0f, 1.0f);
-    basicProgram.setUniformMatrix4f("modelview", modelview);
+	setDrawState(GL_LINE, true, true);
+	boxProgram.use();
+    boxProgram.setUniform(boxUniforms.color, glm::vec4(0.8f, 0.8f, 0.0f, 1.0f));
+    boxProgram.setUniform(boxUniforms.modelview, modelview);
     cube->render();
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+// Helper function to render a filled AABB for occlusion queries,
+// without writing to the color and depth buffers
+void Scene::renderAABBProxy(const AABB& aabb)
+{
+	center = (aabb.min + aabb.max) * 0.5f;
+	scale = aabb.max - aabb.min;
+
+	modelCube = glm::mat4(1.0f);
+	modelCube = glm::translate(modelCube, center);
+	modelCube = glm::scale(modelCube, scale);
+	modelview = camera.getModelViewMatrix() * modelCube;
+
+	boxProgram.use();
+	boxProgram.setUniform(boxUniforms.modelview, modelview);
+
+	setDrawState(GL_FILL, false, false);
+	cube->render();
+}
+
+// Render the proxy of an instance for an occlusion query: its 26-DOP, or its AABB cube
+void Scene::renderInstanceProxy(int i)
+{
+	if (!tightProxies)
+	{
+		renderAABBProxy(instanceAABBs.getAABB(i));
+		return;
+	}
+
+	// Its modelview comes from the instance buffer, like in the depth pre-pass
+	depthProgram.use();
+	depthProgram.setUniform(depthUniforms.instance, i);
+
+	setDrawState(GL_FILL, false, false);
+	proxyMesh->render();
+}
+
+// Render the proxy of a quadtree node. The proxies of the instances of a leaf
+// cover less of the screen than the AABB of the whole leaf.
+void Scene::renderNodeProxy(QuadTreeNodeIndex node)
+{
+	if (!tightProxies || !quadTree.isLeaf(node))
+	{
+		renderAABBProxy(quadTree.nodes[node].aabb);
+		return;
+	}
+
+	const QuadTreeNode &n = quadTree.nodes[node];
+	for (int k = n.begin; k < n.end; k++)
+		renderInstanceProxy(quadTree.instances[k]);
+}
+
+// Check if the camera position lies inside an AABB
+bool Scene::isCameraInsideAABB(const AABB& aabb)
+{
+	const glm::vec3 &eye = camera.getPosition();
+	return glm::all(glm::greaterThanEqual(eye, aabb.min)) && glm::all(glm::lessThanEqual(eye, aabb.max));
 }
 
 // View Frustum 
 bool Scene::isAABBInsideFrustum(const AABB& aabb)
 {
-	// Fetch tha camera's frustum planes
-	const Frustum& frustum = camera.getFrustum();
+	// Test the n-vertex of the AABB against each of the camera's frustum planes
+	return FrustumCuller::isInside(camera.getFrustum(), aabb);
+}
 
-	// Iterate through each frustum plane
-    for (const glm::vec4& frustumPlane : frustum.planes) {
+// OBB of an instance, the OBB of the mesh placed like the instance
+OBB Scene::getInstanceOBB(int i)
+{
+	return meshProxy.transform(getInstanceModel(i));
+}
 
-		// Intersection-check boolean
-        bool intersect = false;
+// Frustum test of a single instance, with its AABB and then its OBB. The OBB
+// is only tested when it is smaller than the AABB.
+bool Scene::isInstanceInsideFrustum(int i)
+{
+	if (!isAABBInsideFrustum(instanceAABBs.getAABB(i)))
+		return false;
+	return !tightProxies || !meshProxy.isOBBTighter() || FrustumCuller::isInside(camera.getFrustum(), getInstanceOBB(i));
+}
 
-        // Test AABB against each face of the frustum
-        for (int i = 0; i < 6; ++i) {
+// Fill frustumVisibleInstances with the instances inside the frustum, testing
+// their AABBs in batches on the job system, or traversing the quadtree, the BVH
+// or the cells of the grid
+void Scene::cullInstances()
+{
+	auto start = std::chrono::steady_clock::now();
 
-			// Extract the x, y, z values from frustumPlane, representing the plane's normal
-            glm::vec3 normal(frustumPlane);
+	if (viewFrustumCulling && cullingHierarchy == QUADTREE_CULLING)
+	{
+		frustumVisibleInstances.clear();
+		cullQuadTreeNode(quadTree.root(), FrustumCuller::ALL_PLANES);
+	}
+	else if (viewFrustumCulling && cullingHierarchy == BVH_CULLING)
+	{
+		frustumVisibleInstances.clear();
+		instanceBVH.cull(camera.getFrustum(), frustumVisibleInstances);
+	}
+	else if (viewFrustumCulling && cullingHierarchy == GRID_CULLING)
+	{
+		frustumVisibleInstances.clear();
+		instanceGrid.cull(camera.getFrustum(), frustumVisibleInstances);
+	}
+	else if (viewFrustumCulling)
+	{
+		// Cull chunks of 32-instance mask words in parallel, then compact the mask
+		int words = (modelCopies + 31) / 32;
+		frustumVisibleMask.resize(words);
+		jobSystem.parallelFor(words, 128, [this](int, int begin, int end)
+		{
+			instanceAABBs.cull(camera.getFrustum(), frustumVisibleMask, begin * 32, end * 32);
+		});
+
+		frustumVisibleInstances.clear();
+		for (int w = 0; w < words; w++)
+			for (unsigned int bits = frustumVisibleMask[w], b = 0; bits != 0; bits >>= 1, b++)
+				if (bits & 1u)
+					frustumVisibleInstances.push_back(w * 32 + b);
+	}
+	else
+	{
+		frustumVisibleInstances.resize(modelCopies);
+		for (int i = 0; i < modelCopies; i++)
+			frustumVisibleInstances[i] = i;
+	}
 
-            // Determine the closest AABB corner to the frustum plane
-            glm::vec3 closestPoint;
+	// The instances are only translated, so an OBB that fell back to the AABB of
+	// the mesh would give the same result as their AABBs
+	if (viewFrustumCulling && tightProxies && meshProxy.isOBBTighter())
+		cullInstanceOBBs();
+	cullSmallInstances();
 
-            closestPoint.x = (normal.x >= 0.0f) ? aabb.min.x : aabb.max.x;
-            closestPoint.y = (normal.y >= 0.0f) ? aabb.min.y : aabb.max.y;
-            closestPoint.z = (normal.z >= 0.0f) ? aabb.min.z : aabb.max.z;
+	cullingTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-            // Compute the signed distance from the closest AABB corner to the frustum plane
-            float signedDistance = glm::dot(closestPoint, normal) + frustumPlane.w;
+// Contribution culling: drop the instances whose projected AABB covers fewer pixels
+// than the threshold. The bounding rectangle of the projection is an upper bound
+// of the pixels the instance can cover, so this never drops a larger instance.
+void Scene::cullSmallInstances()
+{
+	if (contributionThreshold <= 0)
+		return;
 
-            // If the signed distance is negative, the AABB is outside the frustum
-            if (signedDistance < 0.0f) {
-                intersect = true;
-                break;
-            }
-        }
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glm::mat4 viewProjection = camera.getProjectionMatrix() * camera.getModelViewMatrix();
 
-        // If the AABB does not intersect with any frustum face, it is outside the frustum
-        if (!intersect) {
-            return false;
-        }
-    }
+	std::size_t kept = 0;
+	for (std::size_t c = 0; c < frustumVisibleInstances.size(); c++)
+	{
+		int i = frustumVisibleInstances[c];
+		const AABB aabb = instanceAABBs.getAABB(i);
+
+		glm::vec2 screenMin(1.0f), screenMax(-1.0f);
+		bool crossesNearPlane = false;
+		for (int k = 0; k < 8 && !crossesNearPlane; k++)
+		{
+			glm::vec3 corner((k & 1) ? aabb.max.x : aabb.min.x, (k & 2) ? aabb.max.y : aabb.min.y, (k & 4) ? aabb.max.z : aabb.min.z);
+			glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+			crossesNearPlane = clip.w <= 0.0f;
+			screenMin = glm::min(screenMin, glm::vec2(clip) / clip.w);
+			screenMax = glm::max(screenMax, glm::vec2(clip) / clip.w);
+		}
+		screenMin = glm::max(screenMin, glm::vec2(-1.0f));
+		screenMax = glm::min(screenMax, glm::vec2(1.0f));
+		glm::vec2 size = glm::max(screenMax - screenMin, glm::vec2(0.0f)) * 0.5f * glm::vec2(viewport[2], viewport[3]);
+
+		if (crossesNearPlane || size.x * size.y >= contributionThreshold)
+			frustumVisibleInstances[kept++] = i;
+		else
+			contributionCulled++;
+	}
+	frustumVisibleInstances.resize(kept);
+}
+
+// Order the instances inside the frustum nearest first
+void Scene::sortInstances()
+{
+	if (frontToBackSorting)
+		depthSortReused = !depthSorter.sort(frustumVisibleInstances, positions, camera.getModelViewMatrix(), &jobSystem);
+}
 
-    return true;
+// Drop the instances whose AABB is inside the frustum but whose OBB is not
+void Scene::cullInstanceOBBs()
+{
+	const Frustum &frustum = camera.getFrustum();
+
+	std::size_t kept = 0;
+	for (std::size_t c = 0; c < frustumVisibleInstances.size(); c++)
+	{
+		int i = frustumVisibleInstances[c];
+		if (FrustumCuller::isInside(frustum, getInstanceOBB(i)))
+			frustumVisibleInstances[kept++] = i;
+		else
+			obbCulled++;
+	}
+	frustumVisibleInstances.resize(kept);
+}
+
+// Whether a finished query is visible, with at least as many samples as the contribution
+// culling threshold. The ones that pass only a few samples count as contribution culled.
+bool Scene::isQueryVisible(const Query &query)
+{
+	GLuint samples = query.result();
+	if (samples > 0 && samples < GLuint(contributionThreshold))
+		contributionCulled++;
+	return samples >= GLuint(std::max(contributionThreshold, 1));
+}
+
+// Hierarchical frustum culling. planeMask holds the planes the parent intersects:
+// the node skips the others, since the parent is fully inside them. Nodes fully
+// inside the frustum accept all their instances without any further test.
+void Scene::cullQuadTreeNode(QuadTreeNodeIndex node, unsigned int planeMask)
+{
+	QuadTreeNode &n = quadTree.nodes[node];
+	if (quadTree.isEmpty(node))
+		return;
+
+	if (FrustumCuller::classify(camera.getFrustum(), n.aabb, planeMask, n.lastFailingPlane) == FrustumCuller::OUTSIDE)
+		return;
+
+	// The instances below the node are contiguous, so a node fully inside takes them all at once
+	if (planeMask == 0)
+	{
+		frustumVisibleInstances.insert(frustumVisibleInstances.end(), quadTree.instances.begin() + n.begin, quadTree.instances.begin() + n.end);
+		return;
+	}
+
+	if (!quadTree.isLeaf(node))
+	{
+		for (int c = 0; c < 4; c++)
+			cullQuadTreeNode(quadTree.child(node, c), planeMask);
+		return;
+	}
+
+	for (int k = n.begin; k < n.end; k++)
+	{
+		unsigned int instanceMask = planeMask;
+		int lastPlane = n.lastFailingPlane;
+		if (FrustumCuller::classify(camera.getFrustum(), instanceAABBs.getAABB(quadTree.instances[k]), instanceMask, lastPlane) != FrustumCuller::OUTSIDE)
+			frustumVisibleInstances.push_back(quadTree.instances[k]);
+	}
 }
 
 // Load, compile, and link the vertex and fragment shader
@@ -557,4 +1781,72 @@ void Scene::initShaders()
 	gouraudProgram.bindFragmentOutput("outColor");
 	vShader.free();
 	fShader.free();
+
+	// Setup the position-only shader of the depth pre-pass
+	vShader.initFromFile(VERTEX_SHADER, "shaders/depth.vert");
+	if(!vShader.isCompiled())
+	{
+		cout << "Vertex Shader Error" << endl;
+		cout << "" << vShader.log() << endl << endl;
+	}
+	fShader.initFromFile(FRAGMENT_SHADER, "shaders/depth.frag");
+	if(!fShader.isCompiled())
+	{
+		cout << "Fragment Shader Error" << endl;
+		cout << "" << fShader.log() << endl << endl;
+	}
+	depthProgram.init();
+	depthProgram.addShader(vShader);
+	depthProgram.addShader(fShader);
+	depthProgram.link();
+	if(!depthProgram.isLinked())
+	{
+		cout << "Shader Linking Error" << endl;
+		cout << "" << depthProgram.log() << endl << endl;
+	}
+	vShader.free();
+	fShader.free();
+
+	// Setup the shader of the AABB cubes and proxies, with the fragment shader of the instances
+	vShader.initFromFile(VERTEX_SHADER, "shaders/box.vert");
+	if(!vShader.isCompiled())
+	{
+		cout << "Vertex Shader Error" << endl;
+		cout << "" << vShader.log() << endl << endl;
+	}
+	fShader.initFromFile(FRAGMENT_SHADER, "shaders/basic.frag");
+	if(!fShader.isCompiled())
+	{
+		cout << "Fragment Shader Error" << endl;
+		cout << "" << fShader.log() << endl << endl;
+	}
+	boxProgram.init();
+	boxProgram.addShader(vShader);
+	boxProgram.addShader(fShader);
+	boxProgram.link();
+	if(!boxProgram.isLinked())
+	{
+		cout << "Shader Linking Error" << endl;
+		cout << "" << boxProgram.log() << endl << endl;
+	}
+	boxProgram.bindFragmentOutput("outColor");
+	vShader.free();
+	fShader.free();
+
+	// Resolve the uniforms set for every draw
+	basicUniforms.resolve(basicProgram);
+	gouraudUniforms.resolve(gouraudProgram);
+	depthUniforms.resolve(depthProgram);
+	boxUniforms.resolve(boxProgram);
+
+	// The programs of the render queue, by shading technique
+	shadingQueuePrograms[PHONG] = renderQueue.addProgram(&basicProgram, basicUniforms.instance);
+	shadingQueuePrograms[GOURAUD] = renderQueue.addProgram(&gouraudProgram, gouraudUniforms.instance);
+}
+
+void Scene::DrawUniforms::resolve(const ShaderProgram &program)
+{
+	instance = program.getUniform<int>("instance");
+	modelview = program.getUniform<glm::mat4>("modelview");
+	color = program.getUniform<glm::vec4>("color");
 }
@@ -10,11 +10,28 @@
 #include "Query.h"
 #include "QueryPool.h"
 #include "QuadTree.h"
+#include "GPUCuller.h"
+#include "InstancedRenderer.h"
+#include "UniformBlocks.h"
+#include "GLState.h"
+#include "RenderQueue.h"
+#include "HiZBuffer.h"
+#include "SoftwareRasterizer.h"
+#include "OccluderMesh.h"
+#include "FrustumCuller.h"
+#include "BoundingProxy.h"
+#include "DepthSorter.h"
+#include "BVH.h"
+#include "SpatialGrid.h"
+#include "PVS.h"
+#include "JobSystem.h"
 
 #include <queue>
 #include <stack>
 #include <utility>
 #include <unordered_set>
+#include <random>
+#include <functional>
 
 // Scene contains all the entities of our game.
 // It is responsible for updating and render them.
@@ -33,11 +50,23 @@ public:
   	VectorCamera &getCamera();
 	float sceneFps;
 
-	// Calculate and reset the instance AABBs
-    void calculateInstanceAABB(AABB& aabb, int i);
-    void resetInstanceAABB(AABB& aabb, int i);
 
 private:
+	// Queries in flight of the CHC and CHC++ traversals
+	struct CHCQuery
+	{
+		QuadTreeNodeIndex node;
+		Query query;
+		bool wasVisible;
+	};
+	// A CHC++ query covers the [begin, end) range of multiQueryNodes
+	struct CHCMultiQuery
+	{
+		int begin, end;
+		Query query;
+		bool wasVisible;
+	};
+
 	// General functions
 	void initShaders();
 	void computeModelViewMatrix();
@@ -51,22 +80,82 @@ private:
 	// -----------------------------------------
 	// // Frustum culling
 	bool isAABBInsideFrustum(const AABB& aabb);
+	void cullInstances();
+	void cullQuadTreeNode(QuadTreeNodeIndex node, unsigned int planeMask);
+	void moveInstances();
+	void buildInstanceStructures();
+	void setInstanceLayout(const float *layout);
+	void cullSmallInstances();
+	void cullInstanceOBBs();
+	OBB getInstanceOBB(int i);
+	bool isInstanceInsideFrustum(int i);
+	void sortInstances();
+	bool isQueryVisible(const Query &query);
 	// // Techniques
+	void renderDepthPrePass();
 	void renderOnlyAABB();
 	void renderDefault();
 	void renderOcclusionCulling();
+	void renderAsyncOcclusionCulling();
+	void renderConditional();
+	void renderGPUCulling();
+	void renderInstanced();
+	void renderHiZCulling();
+	void renderSoftwareOcclusionCulling();
+	void renderPVS();
+	void bakePVS();
 	void renderCHC();
+	void renderCHCPlusPlus();
 
 	// CHC helper functions
-	//
-	//
+	void traverseNode(QuadTreeNodeIndex node);
+	void pullUpVisibility(QuadTreeNodeIndex node);
+	void issueOcclusionQuery(QuadTreeNodeIndex node, bool wasVisible);
+	void renderQuadTreeLeaf(QuadTreeNodeIndex node);
+	void renderQuadTreeLeafOccluded(QuadTreeNodeIndex node);
+	void prepareInstanceConstants();
+	glm::mat4 getInstanceModel(int i);
+	void renderInstance(int i);
+	void queueInstance(int i);
+	void submitRenderQueue();
+	// Set the state a draw needs, through the GLState cache
+	void setDrawState(GLenum polygonMode, bool colorWrite, bool depthWrite);
+	void renderAABBProxy(const AABB& aabb);
+	void renderInstanceProxy(int i);
+	void renderNodeProxy(QuadTreeNodeIndex node);
+	bool isCameraInsideAABB(const AABB& aabb);
+
+	// CHC++ helper functions
+	void traverseNodeCHCPlusPlus(QuadTreeNodeIndex node);
+	void queryPreviouslyInvisibleNode(QuadTreeNodeIndex node);
+	void issueMultiQueries();
+	void issueMultiQuery(int begin, int end, bool wasVisible);
+	void handleReturnedQuery(const CHCMultiQuery& entry);
 
 private:
+	// Worker threads of the CPU side work of the frame
+	JobSystem jobSystem;
+
 	// General
 	VectorCamera camera;
 	TriangleMesh *cube, *mesh;
 	ShaderProgram basicProgram;
 	ShaderProgram gouraudProgram;
+	ShaderProgram depthProgram;
+	// AABB cubes and query proxies, which are not instances
+	ShaderProgram boxProgram;
+	// Uniforms set for every draw, resolved once after linking the programs
+	struct DrawUniforms
+	{
+		UniformHandle<int> instance;
+		UniformHandle<glm::mat4> modelview;
+		UniformHandle<glm::vec4> color;
+
+		void resolve(const ShaderProgram &program);
+	};
+	DrawUniforms basicUniforms, gouraudUniforms, depthUniforms, boxUniforms;
+	// Camera, lights and instance matrices, uploaded once per frame
+	UniformBlocks uniformBlocks;
 	float currentTime;
 	unsigned int currentFrame;
 	AABB meshAABB;
@@ -83,27 +172,148 @@ private:
 
 	// Numerical input for model irregular grid display
 	int renderedModels;
+	int issuedQueries;
   	int modelCopies = 252;
 	// !! Important: Set all to 3 * modelCopies. Here, modelCopies=252 , so all: [756] !!
 	float positions			[756];
 	float rotationAxis		[756];
 	float colors			[756];
 	float rotationAngle 		[756];
+	// Positions the animated instances orbit around
+	float basePositions		[756];
+	// Random layout generated at startup, restored when the PVS layout is turned off
+	float randomPositions		[756];
 
 	// Scene rendering data
     bool viewFrustumCulling;
+	int cullingHierarchy;
+	enum cullingHierarchyType
+	{
+		FLAT_CULLING,
+		QUADTREE_CULLING,
+		BVH_CULLING,
+		GRID_CULLING
+	};
+	// Moving instances refit the quadtree and the BVH, which rebuilds its degraded subtrees,
+	// and move between the cells of the grid
+	bool animateInstances;
+	BVH instanceBVH;
+	int bvhRebuiltSubtrees;
+	SpatialGrid instanceGrid;
+	float gridCellSize = 1.0f;
+	// CPU time of the frustum culling of the last frame, to compare the structures
+	float cullingTime;
+	// Contribution culling: instances covering fewer pixels than the threshold are dropped,
+	// by their projected AABB on the CPU and by their samples passed in the query modes
+	int contributionThreshold = 0;
+	int contributionCulled;
+	// Bounds of the mesh tighter than its AABB: the OBBs of the instances refine the
+	// frustum culling, and the 26-DOP replaces the AABB cube in the occlusion queries
+	BoundingProxy meshProxy;
+	TriangleMesh *proxyMesh;
+	bool tightProxies = true;
+	int obbCulled;
+	// Front-to-back order of the visible instances, for early-Z and for the occluders
+	// to reach the depth buffer before the queries of the instances they hide
+	DepthSorter depthSorter;
+	bool frontToBackSorting = true;
+	bool depthSortReused;
+	// Depth pre-pass of the default and occlusion culling modes: the first instances of
+	// the draw order, or all of them, are rendered to depth only with a position-only
+	// program. The shading pass then tests with GL_LEQUAL, or GL_EQUAL when all of them
+	// are in the depth buffer, so every pixel is shaded once, and the queries test
+	// against the complete depth.
+	int depthPrePass;
+	enum depthPrePassType
+	{
+		NO_DEPTH_PREPASS,
+		OCCLUDER_DEPTH_PREPASS,
+		FULL_DEPTH_PREPASS
+	};
+	int prePassOccluders = 16;
+	int prePassDraws;
+	GLenum shadingDepthFunc;
+	// The default and occlusion culling modes queue the instances they find visible,
+	// and draw them sorted by program, mesh and depth. The occlusion culling mode
+	// issues its queries in batches, and submits the visible instances of a batch
+	// before querying the next one.
+	RenderQueue renderQueue;
+	int shadingQueuePrograms[2];
+	int meshQueueIndex = -1;
+	int queryBatchSize = 4;
+	int queueSubmits, queueProgramChanges;
+	// AABBs of the instances, and the ones inside the frustum in the current frame
+	FrustumCuller instanceAABBs;
+	std::vector<unsigned int> frustumVisibleMask;
+	std::vector<int> frustumVisibleInstances;
+	// Model and modelview matrix of every instance in the current frame
+	std::vector<glm::mat4> instanceModels;
+	std::vector<glm::mat4> instanceModelviews;
 	bool isAABBRendered;
 	bool isOcclusionCulled;
 	
-	vector<Query> queries;
-	vector<GLuint> queryIdx;
-	bool firstTimeQueries;
-	vector<QueryPool> qp;
-	//QueryPool queryPool;
+	// Stop and wait occlusion queries, one per instance
+	QueryPool stopAndWaitQueries;
+
+	// Asynchronous occlusion queries: one query per instance for each of the
+	// last maxQueryLatency + 1 frames, read back queryLatency frames later
+	static const int maxQueryLatency = 4;
+	int queryLatency = 1;
+	QueryPool asyncQueries;
+
+	// Conditional rendering: the GPU skips the draws of the instances whose proxy
+	// query fails. Skipped draws are measured with a primitives generated query
+	// per frame, read back when the oldest frame in flight is done.
+	QueryPool conditionalQueries;
+	QueryPool statisticsQueries;
+	int conditionalDraws[maxQueryLatency + 1];
+	int conditionalProxyTriangles[maxQueryLatency + 1];
+	int skippedDraws;
+
+	// GPU-driven culling and indirect rendering
+	GPUCuller gpuCuller;
+	// Hardware instancing: the instances inside the frustum in a single instanced draw
+	InstancedRenderer instancedRenderer;
+	HiZBuffer hiZBuffer;
+
+	// Software occlusion culling: the simplified occluder meshes of the instances with
+	// the largest projected area are rasterized on the CPU, and every instance AABB is
+	// tested against their depth
+	SoftwareRasterizer softwareRasterizer;
+	OccluderMesh meshOccluder;
+	int softwareOccluders = 8;
+	int softwareOccluderTriangles;
+	std::vector<std::pair<float, int>> softwareOccluderAreas;
+	std::vector<AABB> softwareAABBs;
+	std::vector<char> softwareOccluded;
+
+	// Potentially visible sets of the view cells, baked with the "Bake PVS" button. A
+	// saved file is loaded at startup, but only used if it was baked for the current
+	// layout. With restorePVSLayout ("Use the PVS layout"), its layout replaces the
+	// random one, which makes PVS runs repeatable but changes the scene of every
+	// other technique too.
+	PVS pvs;
+	std::string pvsFilename = "../models/bunny.pvs";
+	bool restorePVSLayout = false;
+	int pvsCell;
 
 	// CHC helper elements
-    // ...
-	// ...
+	QuadTree quadTree;
+	int quadTreeDepth = 3;
+	QueryPool chcQueries;
+	std::stack<QuadTreeNodeIndex> traversalStack;
+	std::queue<CHCQuery> queryQueue;
+
+	// CHC++ helper elements
+	typedef std::pair<float, QuadTreeNodeIndex> DistanceEntry;
+	std::priority_queue<DistanceEntry, std::vector<DistanceEntry>, std::greater<DistanceEntry>> distanceQueue;
+	std::queue<CHCMultiQuery> multiQueryQueue;
+	std::vector<QuadTreeNodeIndex> invisibleQueue;
+	std::queue<QuadTreeNodeIndex> visibleQueue;
+	std::vector<QuadTreeNodeIndex> multiQueryNodes;
+	int maxBatchSize = 50;
+	int visibleQueryInterval = 8;
+	std::mt19937 randomGenerator;
 
 	// For the rendering mode radio button of the UI
 	int renderingMode;
@@ -112,7 +322,15 @@ private:
 		DEFAULT,
 		OCCLUSION_CULLING,
 		ONLY_AABB,
-		CHC
+		CHC,
+		CHC_PLUS_PLUS,
+		ASYNC_OCCLUSION_CULLING,
+		CONDITIONAL_RENDERING,
+		GPU_CULLING,
+		HIZ_CULLING,
+		SOFTWARE_OCCLUSION_CULLING,
+		PVS_RENDERING,
+		INSTANCED_RENDERING
 	};
 
 	// For the rendering shader radio button of the UI
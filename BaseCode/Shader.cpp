@@ -26,6 +26,9 @@ void Shader::initFromSource(const ShaderType type, const string &source)
 	case FRAGMENT_SHADER:
 		shaderId = glCreateShader(GL_FRAGMENT_SHADER);
 		break;
+	case COMPUTE_SHADER:
+		shaderId = glCreateShader(GL_COMPUTE_SHADER);
+		break;
 	}
 	if(shaderId == 0)
 		return;
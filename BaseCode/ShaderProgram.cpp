@@ -1,6 +1,8 @@
 #include <iostream>
+#include <algorithm>
 #include <glm/gtc/type_ptr.hpp>
 #include "ShaderProgram.h"
+#include "GLState.h"
 
 
 ShaderProgram::ShaderProgram()
@@ -45,16 +47,20 @@ void ShaderProgram::link()
 	linked = (status == GL_TRUE);
 	glGetProgramInfoLog(programId, 512, NULL, buffer);
 	errorLog.assign(buffer);
+
+	if(linked)
+		reflectUniforms();
 }
 
 void ShaderProgram::free()
 {
-	glDeleteProgram(programId);
+	GLState::deleteProgram(programId);
+	uniforms.clear();
 }
 
 void ShaderProgram::use()
 {
-	glUseProgram(programId);
+	GLState::useProgram(programId);
 }
 
 bool ShaderProgram::isLinked()
@@ -67,51 +73,165 @@ const string &ShaderProgram::log() const
 	return errorLog;
 }
 
-void ShaderProgram::setUniform1i(const string &uniformName, int v)
+void ShaderProgram::setUniform1i(const UniformName &uniformName, int v)
+{
+	const Uniform *uniform = findUniform(uniformName);
+
+	if(uniform != NULL)
+		glUniform1i(uniform->location, v);
+}
+
+void ShaderProgram::setUniform2f(const UniformName &uniformName, float v0, float v1)
+{
+	const Uniform *uniform = findUniform(uniformName);
+
+	if(uniform != NULL)
+		glUniform2f(uniform->location, v0, v1);
+}
+
+void ShaderProgram::setUniform3f(const UniformName &uniformName, float v0, float v1, float v2)
+{
+	const Uniform *uniform = findUniform(uniformName);
+
+	if(uniform != NULL)
+		glUniform3f(uniform->location, v0, v1, v2);
+}
+
+void ShaderProgram::setUniform4f(const UniformName &uniformName, float v0, float v1, float v2, float v3)
+{
+	const Uniform *uniform = findUniform(uniformName);
+
+	if(uniform != NULL)
+		glUniform4f(uniform->location, v0, v1, v2, v3);
+}
+
+void ShaderProgram::setUniformMatrix3f(const UniformName &uniformName, const glm::mat3 &mat)
+{
+	const Uniform *uniform = findUniform(uniformName);
+
+	if(uniform != NULL)
+		glUniformMatrix3fv(uniform->location, 1, GL_FALSE, glm::value_ptr(mat));
+}
+
+void ShaderProgram::setUniformMatrix4f(const UniformName &uniformName, const glm::mat4 &mat)
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	const Uniform *uniform = findUniform(uniformName);
 
-	if(location != -1)
-		glUniform1i(location, v);
+	if(uniform != NULL)
+		glUniformMatrix4fv(uniform->location, 1, GL_FALSE, glm::value_ptr(mat));
 }
 
-void ShaderProgram::setUniform2f(const string &uniformName, float v0, float v1)
+void ShaderProgram::setUniform(UniformHandle<int> handle, int v)
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	if(handle.isValid())
+		glUniform1i(handle.location, v);
+}
 
-	if(location != -1)
-		glUniform2f(location, v0, v1);
+void ShaderProgram::setUniform(UniformHandle<float> handle, float v)
+{
+	if(handle.isValid())
+		glUniform1f(handle.location, v);
 }
 
-void ShaderProgram::setUniform3f(const string &uniformName, float v0, float v1, float v2)
+void ShaderProgram::setUniform(UniformHandle<glm::vec2> handle, const glm::vec2 &v)
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	if(handle.isValid())
+		glUniform2fv(handle.location, 1, glm::value_ptr(v));
+}
+
+void ShaderProgram::setUniform(UniformHandle<glm::vec3> handle, const glm::vec3 &v)
+{
+	if(handle.isValid())
+		glUniform3fv(handle.location, 1, glm::value_ptr(v));
+}
 
-	if(location != -1)
-		glUniform3f(location, v0, v1, v2);
+void ShaderProgram::setUniform(UniformHandle<glm::vec4> handle, const glm::vec4 &v)
+{
+	if(handle.isValid())
+		glUniform4fv(handle.location, 1, glm::value_ptr(v));
 }
 
-void ShaderProgram::setUniform4f(const string &uniformName, float v0, float v1, float v2, float v3)
+void ShaderProgram::setUniform(UniformHandle<glm::mat3> handle, const glm::mat3 &mat)
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	if(handle.isValid())
+		glUniformMatrix3fv(handle.location, 1, GL_FALSE, glm::value_ptr(mat));
+}
 
-	if(location != -1)
-		glUniform4f(location, v0, v1, v2, v3);
+void ShaderProgram::setUniform(UniformHandle<glm::mat4> handle, const glm::mat4 &mat)
+{
+	if(handle.isValid())
+		glUniformMatrix4fv(handle.location, 1, GL_FALSE, glm::value_ptr(mat));
 }
 
-void ShaderProgram::setUniformMatrix3f(const string &uniformName, glm::mat3 &mat)
+// Store the location and type of every active uniform. An array is reported by
+// the name of its first element: both its name and each element are stored.
+void ShaderProgram::reflectUniforms()
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	uniforms.clear();
+	vector<char> buffer(max(maxLength, 1));
+	for(GLint u=0; u<count; u++)
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(programId, u, GLsizei(buffer.size()), NULL, &size, &type, buffer.data());
+
+		// The uniforms of uniform blocks have no location
+		GLint location = glGetUniformLocation(programId, buffer.data());
+		if(location == -1)
+			continue;
 
-	if(location != -1)
-		glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+		string name(buffer.data());
+		string::size_type bracket = name.find('[');
+		if(bracket == string::npos)
+		{
+			uniforms.push_back({ hashUniformName(name.c_str()), location, type });
+			continue;
+		}
+
+		name.erase(bracket);
+		uniforms.push_back({ hashUniformName(name.c_str()), location, type });
+		for(GLint element=0; element<size; element++)
+		{
+			string elementName = name + "[" + to_string(element) + "]";
+			uniforms.push_back({ hashUniformName(elementName.c_str()), glGetUniformLocation(programId, elementName.c_str()), type });
+		}
+	}
+	sort(uniforms.begin(), uniforms.end());
+
+	// Names with the same hash can not be told apart
+	for(unsigned int u=1; u<uniforms.size(); u++)
+		if(uniforms[u].hash == uniforms[u - 1].hash && uniforms[u].location != uniforms[u - 1].location)
+			errorLog += "Two uniform names have the same hash\n";
 }
 
-void ShaderProgram::setUniformMatrix4f(const string &uniformName, glm::mat4 &mat)
+const ShaderProgram::Uniform *ShaderProgram::findUniform(const UniformName &uniformName) const
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	Uniform key = { uniformName.hash, -1, GL_NONE };
+	vector<Uniform>::const_iterator found = lower_bound(uniforms.begin(), uniforms.end(), key);
+	if(found == uniforms.end() || found->hash != uniformName.hash)
+		return NULL;
+	return &*found;
+}
 
-	if(location != -1)
-		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+// Integers, booleans, samplers and images are all set with glUniform1i
+bool ShaderProgram::isUniformType(GLenum type, const int *)
+{
+	switch(type)
+	{
+	case GL_INT:
+	case GL_BOOL:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_IMAGE_2D:
+		return true;
+	default:
+		return false;
+	}
 }
 
@@ -2,6 +2,8 @@
 #define _SHADER_PROGRAM_INCLUDE
 
 
+#include <cstddef>
+#include <vector>
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <glm/glm.hpp>
@@ -11,6 +13,37 @@
 // Using the Shader class ShaderProgram can link a vertex and a fragment shader
 // together, bind input attributes to their corresponding vertex shader names, 
 // and bind the fragment output to a name from the fragment shader
+//
+// The active uniforms are reflected once, when the program is linked, into a
+// table from the hash of their names to their locations. Uniforms are looked up
+// by a UniformName, hashed at compile time for string literals, so setting them
+// never builds a string or asks the driver. Handles resolve the lookup itself
+// once, and their type must match the type of the uniform in the shader.
+
+
+// FNV-1a hash of a uniform name
+constexpr unsigned int hashUniformName(const char *name, unsigned int hash = 2166136261u)
+{
+	return (*name == '\0') ? hash : hashUniformName(name + 1, (hash ^ (unsigned char)*name) * 16777619u);
+}
+
+struct UniformName
+{
+	template<std::size_t N>
+	constexpr UniformName(const char (&name)[N]) : hash(hashUniformName(name)) {}
+	UniformName(const string &name) : hash(hashUniformName(name.c_str())) {}
+
+	unsigned int hash;
+};
+
+// Pre-resolved location of a uniform of type T, -1 if the program does not use it
+template<class T>
+struct UniformHandle
+{
+	GLint location = -1;
+
+	bool isValid() const { return location != -1; }
+};
 
 
 class ShaderProgram
@@ -29,23 +62,69 @@ public:
 	void use();
 
 	// Pass uniforms to the associated shaders
-	void setUniform1i(const string &uniformName, int v);
-	void setUniform2f(const string &uniformName, float v0, float v1);
-	void setUniform3f(const string &uniformName, float v0, float v1, float v2);
-	void setUniform4f(const string &uniformName, float v0, float v1, float v2, float v3);
-
-	void setUniformMatrix3f(const string &uniformName, glm::mat3 &mat);
-	void setUniformMatrix4f(const string &uniformName, glm::mat4 &mat);
+	void setUniform1i(const UniformName &uniformName, int v);
+	void setUniform2f(const UniformName &uniformName, float v0, float v1);
+	void setUniform3f(const UniformName &uniformName, float v0, float v1, float v2);
+	void setUniform4f(const UniformName &uniformName, float v0, float v1, float v2, float v3);
+
+	void setUniformMatrix3f(const UniformName &uniformName, const glm::mat3 &mat);
+	void setUniformMatrix4f(const UniformName &uniformName, const glm::mat4 &mat);
+
+	// Resolve a uniform once, to set it through its handle. The handle is invalid
+	// if the program does not use the uniform, or if its type is not T.
+	template<class T>
+	UniformHandle<T> getUniform(const UniformName &uniformName) const;
+
+	void setUniform(UniformHandle<int> handle, int v);
+	void setUniform(UniformHandle<float> handle, float v);
+	void setUniform(UniformHandle<glm::vec2> handle, const glm::vec2 &v);
+	void setUniform(UniformHandle<glm::vec3> handle, const glm::vec3 &v);
+	void setUniform(UniformHandle<glm::vec4> handle, const glm::vec4 &v);
+	void setUniform(UniformHandle<glm::mat3> handle, const glm::mat3 &mat);
+	void setUniform(UniformHandle<glm::mat4> handle, const glm::mat4 &mat);
 
 	bool isLinked();
 	const string &log() const;
 
+private:
+	// Active uniform reflected at link time, sorted by the hash of its name
+	struct Uniform
+	{
+		unsigned int hash;
+		GLint location;
+		GLenum type;
+
+		bool operator<(const Uniform &other) const { return hash < other.hash; }
+	};
+
+	void reflectUniforms();
+	const Uniform *findUniform(const UniformName &uniformName) const;
+	static bool isUniformType(GLenum type, const int *);
+	static bool isUniformType(GLenum type, const float *) { return type == GL_FLOAT; }
+	static bool isUniformType(GLenum type, const glm::vec2 *) { return type == GL_FLOAT_VEC2; }
+	static bool isUniformType(GLenum type, const glm::vec3 *) { return type == GL_FLOAT_VEC3; }
+	static bool isUniformType(GLenum type, const glm::vec4 *) { return type == GL_FLOAT_VEC4; }
+	static bool isUniformType(GLenum type, const glm::mat3 *) { return type == GL_FLOAT_MAT3; }
+	static bool isUniformType(GLenum type, const glm::mat4 *) { return type == GL_FLOAT_MAT4; }
+
 private:
 	GLuint programId;
 	bool linked;
 	string errorLog;
+	std::vector<Uniform> uniforms;
 
 };
 
 
+template<class T>
+UniformHandle<T> ShaderProgram::getUniform(const UniformName &uniformName) const
+{
+	UniformHandle<T> handle;
+	const Uniform *uniform = findUniform(uniformName);
+	if(uniform != NULL && isUniformType(uniform->type, (const T *)NULL))
+		handle.location = uniform->location;
+	return handle;
+}
+
+
 #endif // _SHADER_PROGRAM_INCLUDE
@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <limits>
+#include "SoftwareRasterizer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_RASTERIZER_SSE
+#include <emmintrin.h>
+#endif
+
+
+using namespace std;
+
+
+// Side of the square tiles that keep the farthest depth of their pixels
+#define TILE_SIZE 8
+
+
+SoftwareRasterizer::SoftwareRasterizer()
+{
+	width = height = tilesX = tilesY = 0;
+	jobs = NULL;
+	viewProjection = glm::mat4(1.0f);
+}
+
+
+void SoftwareRasterizer::init(int newWidth, int newHeight, JobSystem *jobSystem)
+{
+	tilesX = max((newWidth + TILE_SIZE - 1) / TILE_SIZE, 1);
+	tilesY = max((newHeight + TILE_SIZE - 1) / TILE_SIZE, 1);
+	width = tilesX * TILE_SIZE;
+	height = tilesY * TILE_SIZE;
+
+	jobs = jobSystem;
+
+	depth.assign(width * height, 1.0f);
+	tileDepth.assign(tilesX * tilesY, 1.0f);
+	screenTriangles.assign(jobs->getNumThreads(), vector<ScreenTriangle>());
+}
+
+void SoftwareRasterizer::clear(const glm::mat4 &newViewProjection)
+{
+	viewProjection = newViewProjection;
+	fill(depth.begin(), depth.end(), 1.0f);
+	fill(tileDepth.begin(), tileDepth.end(), 1.0f);
+	for(vector<ScreenTriangle> &triangles : screenTriangles)
+		triangles.clear();
+	occluders.clear();
+	occluderFirstTriangle.clear();
+}
+
+void SoftwareRasterizer::addOccluder(const vector<glm::vec3> &vertices, const vector<int> &triangles, const glm::vec3 &offset)
+{
+	int firstTriangle = occluders.empty() ? 0 : occluderFirstTriangle.back() + int(occluders.back().triangles->size() / 3);
+
+	occluders.push_back({ &vertices, &triangles, offset });
+	occluderFirstTriangle.push_back(firstTriangle);
+}
+
+// Set up all the occluder triangles, then rasterize them band by band
+void SoftwareRasterizer::rasterize()
+{
+	if(occluders.empty())
+		return;
+
+	int nTriangles = occluderFirstTriangle.back() + int(occluders.back().triangles->size() / 3);
+	// Each thread sets up its triangles into its own list
+	int threads = jobs->getNumThreads();
+	jobs->parallelFor(nTriangles, max(nTriangles / (4 * threads), 64), [this](int thread, int begin, int end)
+	{
+		setupTriangles(begin, end, screenTriangles[thread]);
+	});
+
+	jobs->parallelFor(tilesY, max(tilesY / (2 * threads), 1), [this](int, int begin, int end)
+	{
+		rasterizeBand(begin * TILE_SIZE, end * TILE_SIZE - 1);
+	});
+}
+
+int SoftwareRasterizer::getRasterizedTriangles() const
+{
+	int count = 0;
+	for(const vector<ScreenTriangle> &triangles : screenTriangles)
+		count += int(triangles.size());
+	return count;
+}
+
+// Transform the triangles in [begin, end) to pixel coordinates, and compute their
+// edge functions and depth plane. Back facing triangles are dropped, and so are the
+// ones crossing the near plane: ignoring part of an occluder is always conservative.
+void SoftwareRasterizer::setupTriangles(int begin, int end, vector<ScreenTriangle> &setup) const
+{
+	int occluder = int(upper_bound(occluderFirstTriangle.begin(), occluderFirstTriangle.end(), begin) - occluderFirstTriangle.begin()) - 1;
+
+	for(int t=begin; t<end; t++)
+	{
+		while(occluder + 1 < int(occluders.size()) && t >= occluderFirstTriangle[occluder + 1])
+			occluder++;
+		const Occluder &o = occluders[occluder];
+		const int *indices = &(*o.triangles)[3 * (t - occluderFirstTriangle[occluder])];
+
+		glm::vec3 v[3];
+		bool clipped = false;
+		for(int i=0; i<3; i++)
+		{
+			glm::vec4 clip = viewProjection * glm::vec4((*o.vertices)[indices[i]] + o.offset, 1.0f);
+			if(clip.z < -clip.w || clip.w <= 0.0f)
+			{
+				clipped = true;
+				break;
+			}
+			v[i] = glm::vec3(clip) / clip.w;
+			v[i].x = (v[i].x * 0.5f + 0.5f) * width;
+			v[i].y = (v[i].y * 0.5f + 0.5f) * height;
+			v[i].z = v[i].z * 0.5f + 0.5f;
+		}
+		if(clipped)
+			continue;
+
+		// Counter-clockwise triangles are front facing
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+		if(area <= 0.0f)
+			continue;
+
+		ScreenTriangle triangle;
+		triangle.minX = max(int(floor(min(v[0].x, min(v[1].x, v[2].x)))), 0);
+		triangle.maxX = min(int(ceil(max(v[0].x, max(v[1].x, v[2].x)))), width - 1);
+		triangle.minY = max(int(floor(min(v[0].y, min(v[1].y, v[2].y)))), 0);
+		triangle.maxY = min(int(ceil(max(v[0].y, max(v[1].y, v[2].y)))), height - 1);
+		if(triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			continue;
+
+		// Edge i goes from vertex i to the next one, and is positive on its left
+		for(int i=0; i<3; i++)
+		{
+			const glm::vec3 &a = v[i], &b = v[(i + 1) % 3];
+			triangle.edgeA[i] = a.y - b.y;
+			triangle.edgeB[i] = b.x - a.x;
+			triangle.edgeC[i] = -(triangle.edgeA[i] * a.x + triangle.edgeB[i] * a.y);
+		}
+
+		// Depth plane z = zA * x + zB * y + zC
+		glm::vec3 d1 = v[1] - v[0], d2 = v[2] - v[0];
+		triangle.zA = (d1.z * d2.y - d2.z * d1.y) / area;
+		triangle.zB = (d2.z * d1.x - d1.z * d2.x) / area;
+		triangle.zC = v[0].z - triangle.zA * v[0].x - triangle.zB * v[0].y;
+
+		setup.push_back(triangle);
+	}
+}
+
+// Rasterize every set up triangle into rows [minY, maxY], then update their tiles
+void SoftwareRasterizer::rasterizeBand(int minY, int maxY)
+{
+	if(minY > maxY)
+		return;
+
+	for(const vector<ScreenTriangle> &triangles : screenTriangles)
+		for(const ScreenTriangle &triangle : triangles)
+			if(triangle.maxY >= minY && triangle.minY <= maxY)
+				rasterizeTriangle(triangle, max(triangle.minY, minY), min(triangle.maxY, maxY));
+
+	for(int ty=minY/TILE_SIZE; ty<=maxY/TILE_SIZE; ty++)
+		for(int tx=0; tx<tilesX; tx++)
+		{
+			float farthest = 0.0f;
+			for(int y=ty*TILE_SIZE; y<(ty + 1)*TILE_SIZE; y++)
+				for(int x=tx*TILE_SIZE; x<(tx + 1)*TILE_SIZE; x++)
+					farthest = max(farthest, depth[y * width + x]);
+			tileDepth[ty * tilesX + tx] = farthest;
+		}
+}
+
+// Keep the nearest depth of the pixels whose center is inside the triangle
+void SoftwareRasterizer::rasterizeTriangle(const ScreenTriangle &triangle, int minY, int maxY)
+{
+	// Rows are processed in aligned groups of 4 pixels. The width is a
+	// multiple of 4, and the edge functions reject the pixels outside.
+	int minX = triangle.minX & ~3;
+
+#ifdef SOFTWARE_RASTERIZER_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+	const __m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+	const __m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+	const __m128 zA = _mm_set1_ps(triangle.zA);
+
+	for(int y=minY; y<=maxY; y++)
+	{
+		float py = y + 0.5f;
+		__m128 rowEdge0 = _mm_set1_ps(triangle.edgeB[0] * py + triangle.edgeC[0]);
+		__m128 rowEdge1 = _mm_set1_ps(triangle.edgeB[1] * py + triangle.edgeC[1]);
+		__m128 rowEdge2 = _mm_set1_ps(triangle.edgeB[2] * py + triangle.edgeC[2]);
+		__m128 rowZ = _mm_set1_ps(triangle.zB * py + triangle.zC);
+		float *row = &depth[y * width];
+
+		for(int x=minX; x<=triangle.maxX; x+=4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), pixelOffsets);
+			__m128 inside = _mm_and_ps(
+				_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, px), rowEdge0), zero),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, px), rowEdge1), zero)),
+				_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, px), rowEdge2), zero));
+			if(_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(zA, px), rowZ);
+			__m128 previous = _mm_loadu_ps(row + x);
+			__m128 nearest = _mm_min_ps(previous, z);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+		}
+	}
+#else
+	for(int y=minY; y<=maxY; y++)
+	{
+		float py = y + 0.5f;
+		float *row = &depth[y * width];
+
+		for(int x=minX; x<=triangle.maxX; x++)
+		{
+			float px = x + 0.5f;
+			if(triangle.edgeA[0] * px + triangle.edgeB[0] * py + triangle.edgeC[0] < 0.0f ||
+				triangle.edgeA[1] * px + triangle.edgeB[1] * py + triangle.edgeC[1] < 0.0f ||
+				triangle.edgeA[2] * px + triangle.edgeB[2] * py + triangle.edgeC[2] < 0.0f)
+				continue;
+			row[x] = min(row[x], triangle.zA * px + triangle.zB * py + triangle.zC);
+		}
+	}
+#endif
+}
+
+float SoftwareRasterizer::projectedArea(const AABB &aabb) const
+{
+	glm::vec2 ndcMin(numeric_limits<float>::max());
+	glm::vec2 ndcMax(-numeric_limits<float>::max());
+	for(int c=0; c<8; c++)
+	{
+		glm::vec3 corner((c & 1) ? aabb.max.x : aabb.min.x, (c & 2) ? aabb.max.y : aabb.min.y, (c & 4) ? aabb.max.z : aabb.min.z);
+		glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+		if(clip.z < -clip.w || clip.w <= 0.0f)
+			return 0.0f;
+		glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+
+	glm::vec2 size = glm::max(glm::min(ndcMax, glm::vec2(1.0f)) - glm::max(ndcMin, glm::vec2(-1.0f)), glm::vec2(0.0f));
+	return size.x * size.y / 4.0f;
+}
+
+bool SoftwareRasterizer::isOccluded(const AABB &aabb) const
+{
+	// Screen rectangle and nearest depth of the projected box
+	glm::vec3 screenMin(numeric_limits<float>::max());
+	glm::vec3 screenMax(-numeric_limits<float>::max());
+	for(int c=0; c<8; c++)
+	{
+		glm::vec3 corner((c & 1) ? aabb.max.x : aabb.min.x, (c & 2) ? aabb.max.y : aabb.min.y, (c & 4) ? aabb.max.z : aabb.min.z);
+		glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+		// Boxes crossing the near plane are always visible
+		if(clip.z < -clip.w || clip.w <= 0.0f)
+			return false;
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		screenMin = glm::min(screenMin, ndc);
+		screenMax = glm::max(screenMax, ndc);
+	}
+
+	// Every pixel the rectangle touches, not only the ones whose center it covers
+	int minX = max(int(floor((screenMin.x * 0.5f + 0.5f) * width)), 0);
+	int maxX = min(int(floor((screenMax.x * 0.5f + 0.5f) * width)), width - 1);
+	int minY = max(int(floor((screenMin.y * 0.5f + 0.5f) * height)), 0);
+	int maxY = min(int(floor((screenMax.y * 0.5f + 0.5f) * height)), height - 1);
+	float nearest = screenMin.z * 0.5f + 0.5f;
+	// Outside the screen: left to frustum culling
+	if(minX > maxX || minY > maxY)
+		return false;
+
+	// Most boxes are decided by the farthest depth of their tiles
+	bool tilesOcclude = true;
+	for(int ty=minY/TILE_SIZE; ty<=maxY/TILE_SIZE && tilesOcclude; ty++)
+		for(int tx=minX/TILE_SIZE; tx<=maxX/TILE_SIZE; tx++)
+			if(tileDepth[ty * tilesX + tx] >= nearest)
+			{
+				tilesOcclude = false;
+				break;
+			}
+	if(tilesOcclude)
+		return true;
+
+	for(int y=minY; y<=maxY; y++)
+	{
+		const float *row = &depth[y * width];
+#ifdef SOFTWARE_RASTERIZER_SSE
+		const __m128 nearest4 = _mm_set1_ps(nearest);
+		const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+		for(int x=minX & ~3; x<=maxX; x+=4)
+		{
+			// Only the lanes in [minX, maxX] count
+			__m128i lane = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+			__m128 inRange = _mm_castsi128_ps(_mm_and_si128(
+				_mm_cmpgt_epi32(lane, _mm_set1_epi32(minX - 1)),
+				_mm_cmplt_epi32(lane, _mm_set1_epi32(maxX + 1))));
+			__m128 behind = _mm_cmpge_ps(_mm_loadu_ps(row + x), nearest4);
+			if(_mm_movemask_ps(_mm_and_ps(inRange, behind)) != 0)
+				return false;
+		}
+#else
+		for(int x=minX; x<=maxX; x++)
+			if(row[x] >= nearest)
+				return false;
+#endif
+	}
+
+	return true;
+}
+
+void SoftwareRasterizer::testAABBs(const AABB *aabbs, int count, char *occluded) const
+{
+	jobs->parallelFor(count, 64, [this, aabbs, occluded](int, int begin, int end)
+	{
+		for(int i=begin; i<end; i++)
+			occluded[i] = isOccluded(aabbs[i]) ? 1 : 0;
+	});
+}
@@ -0,0 +1,87 @@
+#ifndef _SOFTWARE_RASTERIZER_INCLUDE
+#define _SOFTWARE_RASTERIZER_INCLUDE
+
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "TriangleMesh.h"
+#include "JobSystem.h"
+
+
+// SoftwareRasterizer renders the depth of a few occluder meshes on the CPU,
+// into a low resolution depth buffer, and tests AABBs against it. It answers
+// visibility in the same frame without any GPU round trip, and it does not
+// need a GL context, so it also runs headless.
+//
+// Each row of pixels is processed 4 at a time with SSE2 when available.
+// Work is split into jobs of the JobSystem: triangle setup by triangle
+// ranges, rasterization by horizontal bands of the depth buffer, and AABB
+// tests by instance ranges. The farthest depth of every 8x8 tile is kept to
+// reject most AABBs without reading their pixels.
+
+class SoftwareRasterizer
+{
+
+public:
+	SoftwareRasterizer();
+
+	// Width and height are rounded up to whole tiles
+	void init(int width, int height, JobSystem *jobSystem);
+
+	// Start a new frame: clear the depth buffer and forget the occluders
+	void clear(const glm::mat4 &viewProjection);
+	// The triangles (3 vertex indices each) of a mesh translated by offset.
+	// The vertices and triangles must stay alive until rasterize().
+	void addOccluder(const vector<glm::vec3> &vertices, const vector<int> &triangles, const glm::vec3 &offset);
+	void rasterize();
+
+	// Fraction of the screen covered by the projected rectangle of an AABB, 0 when
+	// it crosses the near plane. Used to choose the occluders of the frame.
+	float projectedArea(const AABB &aabb) const;
+
+	// An AABB is occluded if all the pixels it covers hold a nearer depth
+	bool isOccluded(const AABB &aabb) const;
+	// Test count AABBs on the worker threads, occluded[i] is set to 1 or 0
+	void testAABBs(const AABB *aabbs, int count, char *occluded) const;
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	// Occluder triangles that survived setup (front facing, in front of the camera)
+	int getRasterizedTriangles() const;
+	const vector<float> &getDepth() const { return depth; }
+
+private:
+	struct Occluder
+	{
+		const vector<glm::vec3> *vertices;
+		const vector<int> *triangles;
+		glm::vec3 offset;
+	};
+
+	// Edge functions and depth plane of a triangle in pixel coordinates
+	struct ScreenTriangle
+	{
+		float edgeA[3], edgeB[3], edgeC[3];
+		float zA, zB, zC;
+		int minX, maxX, minY, maxY;
+	};
+
+	void setupTriangles(int begin, int end, vector<ScreenTriangle> &setup) const;
+	void rasterizeBand(int minY, int maxY);
+	void rasterizeTriangle(const ScreenTriangle &triangle, int minY, int maxY);
+
+private:
+	int width, height, tilesX, tilesY;
+	JobSystem *jobs;
+	glm::mat4 viewProjection;
+	vector<float> depth;
+	vector<float> tileDepth;
+	vector<Occluder> occluders;
+	vector<int> occluderFirstTriangle;
+	// Triangles set up by each thread
+	vector<vector<ScreenTriangle>> screenTriangles;
+
+};
+
+
+#endif // _SOFTWARE_RASTERIZER_INCLUDE
@@ -0,0 +1,178 @@
+#include <cmath>
+#include <limits>
+#include "SpatialGrid.h"
+#include "FrustumCuller.h"
+
+
+using namespace std;
+
+
+// Key of the cell (x, z): the 32 bits of x above the 32 bits of z, packed as
+// unsigned so that negative coordinates are neither shifted nor sign extended
+static constexpr unsigned long long packCell(int x, int z)
+{
+	return (unsigned long long)(unsigned int)x << 32 | (unsigned int)z;
+}
+
+static_assert(packCell(-1, 0) != packCell(0, -1) && packCell(-1, -1) != packCell(0, -1) &&
+	packCell(-1, -1) != packCell(-1, 0) && packCell(-1, 1) != packCell(1, -1), "Cells at negative coordinates must have distinct keys");
+
+
+SpatialGrid::SpatialGrid()
+{
+	cellSize = 1.0f;
+	objectAABB.min = objectAABB.max = glm::vec3(0.0f);
+	visibleCells = occludedCells = 0;
+}
+
+
+void SpatialGrid::init(float newCellSize, const AABB &newObjectAABB, int count)
+{
+	free();
+	cellSize = max(newCellSize, 1e-3f);
+	objectAABB = newObjectAABB;
+	entries.assign(count, { -1, -1, glm::vec3(0.0f) });
+}
+
+void SpatialGrid::free()
+{
+	cells.clear();
+	cellIndices.clear();
+	entries.clear();
+	visibleCells = occludedCells = 0;
+}
+
+void SpatialGrid::insert(int i, const glm::vec3 &position)
+{
+	Entry &entry = entries[i];
+	entry.cell = findCell(position);
+	entry.position = position;
+
+	Cell &cell = cells[entry.cell];
+	entry.slot = int(cell.instances.size());
+	cell.instances.push_back(i);
+
+	// Only the vertical bounds depend on the instances, and they only grow
+	cell.aabb.min.y = min(cell.aabb.min.y, position.y + objectAABB.min.y);
+	cell.aabb.max.y = max(cell.aabb.max.y, position.y + objectAABB.max.y);
+}
+
+void SpatialGrid::remove(int i)
+{
+	Entry &entry = entries[i];
+	if(entry.cell < 0)
+		return;
+
+	// Move the last instance of the cell into the freed slot
+	Cell &cell = cells[entry.cell];
+	int last = cell.instances.back();
+	cell.instances[entry.slot] = last;
+	entries[last].slot = entry.slot;
+	cell.instances.pop_back();
+
+	entry.cell = entry.slot = -1;
+}
+
+void SpatialGrid::move(int i, const glm::vec3 &position)
+{
+	Entry &entry = entries[i];
+	auto found = cellIndices.find(cellKey(position));
+	if(entry.cell >= 0 && found != cellIndices.end() && found->second == entry.cell)
+	{
+		entry.position = position;
+		Cell &cell = cells[entry.cell];
+		cell.aabb.min.y = min(cell.aabb.min.y, position.y + objectAABB.min.y);
+		cell.aabb.max.y = max(cell.aabb.max.y, position.y + objectAABB.max.y);
+		return;
+	}
+
+	remove(i);
+	insert(i, position);
+}
+
+void SpatialGrid::cull(const Frustum &frustum, vector<int> &visibleInstances, const function<bool(const AABB &)> &isOccluded)
+{
+	visibleCells = occludedCells = 0;
+
+	for(Cell &cell : cells)
+	{
+		if(cell.instances.empty())
+			continue;
+
+		unsigned int planeMask = FrustumCuller::ALL_PLANES;
+		if(FrustumCuller::classify(frustum, cell.aabb, planeMask, cell.lastFailingPlane) == FrustumCuller::OUTSIDE)
+			continue;
+		visibleCells++;
+
+		if(isOccluded && isOccluded(cell.aabb))
+		{
+			occludedCells++;
+			continue;
+		}
+
+		if(planeMask == 0)
+		{
+			visibleInstances.insert(visibleInstances.end(), cell.instances.begin(), cell.instances.end());
+			continue;
+		}
+
+		// The cell crosses the frustum: test its instances against the planes it crosses
+		for(int i : cell.instances)
+		{
+			AABB aabb = { objectAABB.min + entries[i].position, objectAABB.max + entries[i].position };
+			unsigned int instanceMask = planeMask;
+			int lastPlane = cell.lastFailingPlane;
+			if(FrustumCuller::classify(frustum, aabb, instanceMask, lastPlane) != FrustumCuller::OUTSIDE)
+				visibleInstances.push_back(i);
+		}
+	}
+}
+
+void SpatialGrid::removeOccluded(vector<int> &instances, const function<bool(const AABB &)> &isOccluded)
+{
+	enum { UNTESTED, VISIBLE, OCCLUDED };
+
+	occludedCells = 0;
+	cellStates.assign(cells.size(), UNTESTED);
+
+	size_t kept = 0;
+	for(int i : instances)
+	{
+		int c = entries[i].cell;
+		if(c >= 0 && cellStates[c] == UNTESTED)
+		{
+			cellStates[c] = isOccluded(cells[c].aabb) ? OCCLUDED : VISIBLE;
+			if(cellStates[c] == OCCLUDED)
+				occludedCells++;
+		}
+		if(c < 0 || cellStates[c] != OCCLUDED)
+			instances[kept++] = i;
+	}
+	instances.resize(kept);
+}
+
+unsigned long long SpatialGrid::cellKey(const glm::vec3 &position) const
+{
+	return packCell(int(floor(position.x / cellSize)), int(floor(position.z / cellSize)));
+}
+
+// Index of the cell containing a position, created if it does not exist yet
+int SpatialGrid::findCell(const glm::vec3 &position)
+{
+	auto found = cellIndices.find(cellKey(position));
+	if(found != cellIndices.end())
+		return found->second;
+
+	float x = floor(position.x / cellSize) * cellSize;
+	float z = floor(position.z / cellSize) * cellSize;
+
+	Cell cell;
+	cell.aabb.min = glm::vec3(x + objectAABB.min.x, numeric_limits<float>::max(), z + objectAABB.min.z);
+	cell.aabb.max = glm::vec3(x + cellSize + objectAABB.max.x, -numeric_limits<float>::max(), z + cellSize + objectAABB.max.z);
+	cell.lastFailingPlane = 0;
+	cells.push_back(cell);
+
+	int index = int(cells.size()) - 1;
+	cellIndices[cellKey(position)] = index;
+	return index;
+}
@@ -0,0 +1,81 @@
+#ifndef _SPATIAL_GRID_INCLUDE
+#define _SPATIAL_GRID_INCLUDE
+
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "TriangleMesh.h"
+#include "VectorCamera.h"
+
+
+// SpatialGrid is a uniform grid over the XZ plane, with its cells stored in a
+// hash map, so it has no bounds and only the cells holding instances exist.
+// An instance belongs to the cell containing its position. The grid is loose:
+// the bounds of a cell are its square grown by the AABB of an instance around
+// its position, so they contain all the instances of the cell and never need
+// to be recomputed. Insert, remove and move are O(1).
+//
+// Culling tests whole cells against the frustum, and optionally against an
+// occlusion test, before testing their instances.
+
+class SpatialGrid
+{
+
+public:
+	SpatialGrid();
+
+	// objectAABB is the AABB of an instance relative to its position
+	void init(float cellSize, const AABB &objectAABB, int count);
+	void free();
+
+	void insert(int i, const glm::vec3 &position);
+	void remove(int i);
+	void move(int i, const glm::vec3 &position);
+
+	// Append the indices of the instances inside the frustum. The cells for which
+	// isOccluded returns true are skipped with all their instances.
+	void cull(const Frustum &frustum, std::vector<int> &visibleInstances,
+		const std::function<bool(const AABB &)> &isOccluded = nullptr);
+	// Remove from a list of instances, keeping its order, the ones whose cell is
+	// occluded. Each cell is tested once, and the occluded ones are counted.
+	void removeOccluded(std::vector<int> &instances, const std::function<bool(const AABB &)> &isOccluded);
+
+	float getCellSize() const { return cellSize; }
+	int getNumCells() const { return int(cells.size()); }
+	// Cells inside the frustum, and the ones of them occluded, in the last cull
+	int getVisibleCells() const { return visibleCells; }
+	int getOccludedCells() const { return occludedCells; }
+
+private:
+	struct Cell
+	{
+		AABB aabb;
+		std::vector<int> instances;
+		int lastFailingPlane;
+	};
+
+	// Where an instance is stored: its cell, and its slot in the cell
+	struct Entry
+	{
+		int cell, slot;
+		glm::vec3 position;
+	};
+
+	unsigned long long cellKey(const glm::vec3 &position) const;
+	int findCell(const glm::vec3 &position);
+
+private:
+	float cellSize;
+	AABB objectAABB;
+	std::vector<Cell> cells;
+	std::unordered_map<unsigned long long, int> cellIndices;
+	std::vector<Entry> entries;
+	std::vector<char> cellStates;
+	int visibleCells, occludedCells;
+
+};
+
+
+#endif // _SPATIAL_GRID_INCLUDE
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <vector>
 #include "TriangleMesh.h"
+#include "GLState.h"
 
 
 using namespace std;
@@ -116,7 +117,7 @@ void TriangleMesh::sendToOpenGL(ShaderProgram &program)
 
   // Send data to OpenGL
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 	glGenBuffers(1, &vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
@@ -126,10 +127,11 @@ void TriangleMesh::sendToOpenGL(ShaderProgram &program)
 
 void TriangleMesh::render() const
 {
-	glBindVertexArray(vao);
-	glEnableVertexAttribArray(posLocation);
-	glEnableVertexAttribArray(normalLocation);
-	glDrawArrays(GL_TRIANGLES, 0, 3 * 2 * 3 * triangles.size() / 3);
+	// Redundant binds and enables are skipped by GLState
+	GLState::bindVertexArray(vao);
+	GLState::enableVertexAttribArray(posLocation);
+	GLState::enableVertexAttribArray(normalLocation);
+	glDrawArrays(GL_TRIANGLES, 0, getNumVertices());
 }
 
 void TriangleMesh::free()
@@ -137,7 +139,7 @@ void TriangleMesh::free()
 	if(vbo != -1)
 		glDeleteBuffers(1, &vbo);
 	if(vao != -1)
-		glDeleteVertexArrays(1, &vao);
+		GLState::deleteVertexArray(vao);
 	
 	vertices.clear();
 	triangles.clear();
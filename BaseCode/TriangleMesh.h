@@ -36,6 +36,11 @@ public:
 	void initTriangles(const vector<int> &newTriangles);
 	
 	const AABB& getAABB() const { return aabb; }
+	const vector<glm::vec3>& getVertices() const { return vertices; }
+	const vector<int>& getTriangles() const { return triangles; }
+	int getNumVertices() const { return triangles.size(); }
+	// Interleaved position and normal of every vertex
+	GLuint getVBO() const { return vbo; }
 
 	void buildCube();
 	
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include "UniformBlocks.h"
+
+
+using namespace std;
+
+
+UniformBlocks::UniformBlocks()
+{
+	frameBuffer = instanceBuffer = 0;
+	maxInstances = 0;
+}
+
+UniformBlocks::~UniformBlocks()
+{
+	free();
+}
+
+
+bool UniformBlocks::init(int newMaxInstances)
+{
+	free();
+
+	maxInstances = newMaxInstances;
+	staging.reserve(maxInstances);
+
+	glGenBuffers(1, &frameBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Frame), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, maxInstances * sizeof(Instance), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The bindings stay for the whole run
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BLOCK_BINDING, instanceBuffer);
+
+	return true;
+}
+
+void UniformBlocks::free()
+{
+	if(frameBuffer != 0)
+		glDeleteBuffers(1, &frameBuffer);
+	if(instanceBuffer != 0)
+		glDeleteBuffers(1, &instanceBuffer);
+	frameBuffer = instanceBuffer = 0;
+	maxInstances = 0;
+	staging.clear();
+}
+
+void UniformBlocks::updateFrame(const glm::mat4 &projection, const glm::mat4 &view, const glm::mat3 &normalMatrix)
+{
+	Frame frame;
+	frame.projection = projection;
+	frame.view = view;
+	for(int c=0; c<3; c++)
+		frame.normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+	// Directional lights, in world space. The shaders normalize them.
+	frame.lightDirections[0] = glm::vec4(1.0f, 2.0f, 3.0f, 0.0f);
+	frame.lightDirections[1] = glm::vec4(-1.0f, 2.0f, -3.0f, 0.0f);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Frame), &frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBlocks::updateInstances(const vector<glm::mat4> &modelviews, const float *colors)
+{
+	staging.resize(min(int(modelviews.size()), maxInstances));
+	for(unsigned int i=0; i<staging.size(); i++)
+	{
+		staging[i].modelview = modelviews[i];
+		staging[i].color = glm::vec4(colors[3*i], colors[3*i+1], colors[3*i+2], 1.0f);
+	}
+	if(staging.empty())
+		return;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, staging.size() * sizeof(Instance), staging.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
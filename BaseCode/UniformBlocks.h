@@ -0,0 +1,65 @@
+#ifndef _UNIFORM_BLOCKS_INCLUDE
+#define _UNIFORM_BLOCKS_INCLUDE
+
+
+#include <vector>
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+
+
+// Binding points of the blocks, as declared in the shaders
+#define FRAME_BLOCK_BINDING 0
+#define INSTANCE_BLOCK_BINDING 4
+
+
+// UniformBlocks holds the shader inputs that do not change between the draws
+// of a frame. The Frame uniform block (std140) has the camera matrices and
+// the lights. The Instances storage buffer (std430) has the modelview matrix
+// and color of every instance of the scene. Both are uploaded once per frame,
+// and a draw of an instance only sets the int uniform that indexes the buffer.
+//
+// The instance buffer uses the binding point 4, after the ones of the
+// culling compute shader, so that dispatching it does not unbind it.
+
+class UniformBlocks
+{
+
+public:
+	UniformBlocks();
+	~UniformBlocks();
+
+	bool init(int maxInstances);
+	void free();
+
+	void updateFrame(const glm::mat4 &projection, const glm::mat4 &view, const glm::mat3 &normalMatrix);
+	// colors holds 3 floats per instance
+	void updateInstances(const std::vector<glm::mat4> &modelviews, const float *colors);
+
+	bool isReady() const { return frameBuffer != 0; }
+
+private:
+	// Layout of the Frame block (std140: a mat3 is three vec4 columns)
+	struct Frame
+	{
+		glm::mat4 projection;
+		glm::mat4 view;
+		glm::vec4 normalMatrix[3];
+		glm::vec4 lightDirections[2];
+	};
+
+	// Layout of an element of the Instances buffer (std430)
+	struct Instance
+	{
+		glm::mat4 modelview;
+		glm::vec4 color;
+	};
+
+	GLuint frameBuffer, instanceBuffer;
+	int maxInstances;
+	std::vector<Instance> staging;
+
+};
+
+
+#endif // _UNIFORM_BLOCKS_INCLUDE
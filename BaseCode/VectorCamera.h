@@ -37,6 +37,7 @@ public:
 	glm::mat4 &getModelViewMatrix();
 
 	const Frustum &getFrustum() const {return frustum;}
+	const glm::vec3 &getPosition() const {return position;}
 
 	// Recording
 	void beginRecording(const std::string &filePath, int duration);
@@ -1,14 +1,21 @@
-#version 130
+#version 430
 
-uniform vec4 color;
+// Camera and lights, set once per frame
+layout(std140, binding = 0) uniform Frame
+{
+	mat4 projection, view;
+	mat3 normalMatrix;
+	vec4 lightDirections[2];
+};
 
 in vec3 normalFrag;
+flat in vec4 colorFrag;
 out vec4 outColor;
 
 void main()
 {
-  vec3 lightDirection = normalize(vec3(1.0, 2.0, 3.0));
-  vec3 lightDirection2 = normalize(vec3(-1.0, 2.0, -3.0));
+  vec3 lightDirection = normalize(lightDirections[0].xyz);
+  vec3 lightDirection2 = normalize(lightDirections[1].xyz);
 
   // Compute simple diffuse directional lighting with some ambient light
   float ambient = 0.2;
@@ -17,5 +24,5 @@ void main()
   float lighting = 0.1f * ambient + 0.8f * diffuse;
 
   // Modulate color with lighting and apply gamma correction
-	outColor = pow(lighting * color, vec4(1.0 / 2.1));
-}
\ No newline at end of file
+	outColor = pow(lighting * colorFrag, vec4(1.0 / 2.1));
+}
@@ -1,17 +1,42 @@
-#version 130
+#version 430
 
-uniform mat4 projection, modelview;
-uniform mat3 normalMatrix;
+// Camera and lights, set once per frame
+layout(std140, binding = 0) uniform Frame
+{
+	mat4 projection, view;
+	mat3 normalMatrix;
+	vec4 lightDirections[2];
+};
+
+struct Instance
+{
+	mat4 modelview;
+	vec4 color;
+};
+
+// All the instances of the scene, set once per frame
+layout(std430, binding = 4) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+// Index of the instance drawn
+uniform int instance;
+
+// Same depth as the depth pre-pass program
+invariant gl_Position;
 
-in vec3 position;
-in vec3 normal;
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
 out vec3 normalFrag;
+flat out vec4 colorFrag;
 
 void main()
 {
   // Transform matrix to viewspace
   normalFrag = normal;
   //normalFrag = normalMatrix * normal;
+  colorFrag = instances[instance].color;
 	// Transform position from pixel coordinates to clipping coordinates
-	gl_Position = projection * modelview * vec4(position, 1.0);
-}
\ No newline at end of file
+	gl_Position = projection * instances[instance].modelview * vec4(position, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 430
+
+// Camera and lights, set once per frame
+layout(std140, binding = 0) uniform Frame
+{
+	mat4 projection, view;
+	mat3 normalMatrix;
+	vec4 lightDirections[2];
+};
+
+// Boxes drawn outside of the instance loops: AABB cubes and query proxies
+uniform mat4 modelview;
+uniform vec4 color;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+out vec3 normalFrag;
+flat out vec4 colorFrag;
+
+void main()
+{
+	normalFrag = normal;
+	colorFrag = color;
+	gl_Position = projection * modelview * vec4(position, 1.0);
+}
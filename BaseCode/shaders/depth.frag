@@ -0,0 +1,6 @@
+#version 330
+
+// Only the depth is written, the color writes are disabled
+void main()
+{
+}
@@ -0,0 +1,35 @@
+#version 430
+
+// Camera and lights, set once per frame
+layout(std140, binding = 0) uniform Frame
+{
+	mat4 projection, view;
+	mat3 normalMatrix;
+	vec4 lightDirections[2];
+};
+
+struct Instance
+{
+	mat4 modelview;
+	vec4 color;
+};
+
+// All the instances of the scene, set once per frame
+layout(std430, binding = 4) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+// Index of the instance drawn
+uniform int instance;
+
+layout(location = 0) in vec3 position;
+
+// Computed exactly like the shading programs, for their GL_EQUAL depth test
+invariant gl_Position;
+
+void main()
+{
+	// Transform position from pixel coordinates to clipping coordinates
+	gl_Position = projection * instances[instance].modelview * vec4(position, 1.0);
+}
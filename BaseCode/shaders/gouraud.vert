@@ -1,10 +1,33 @@
-#version 130
+#version 430
 
-uniform mat4 projection, modelview;
-uniform mat3 normalMatrix;
+// Camera and lights, set once per frame
+layout(std140, binding = 0) uniform Frame
+{
+	mat4 projection, view;
+	mat3 normalMatrix;
+	vec4 lightDirections[2];
+};
+
+struct Instance
+{
+	mat4 modelview;
+	vec4 color;
+};
+
+// All the instances of the scene, set once per frame
+layout(std430, binding = 4) readonly buffer Instances
+{
+	Instance instances[];
+};
+
+// Index of the instance drawn
+uniform int instance;
+
+// Same depth as the depth pre-pass program
+invariant gl_Position;
 
-in vec3 position;
-in vec3 normal;
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
 out vec3 normalFrag;
 out vec3 lightIntensity; // Add new output variable
 
@@ -15,11 +38,11 @@ void main()
     //normalFrag = normalMatrix * normal;
 
     // Transform position from pixel coordinates to clipping coordinates
-    gl_Position = projection * modelview * vec4(position, 1.0);
+    gl_Position = projection * instances[instance].modelview * vec4(position, 1.0);
 
     // Compute lighting at the vertex level
-    vec3 lightDirection = normalize(vec3(1.0, 2.0, 3.0));
-    vec3 lightDirection2 = normalize(vec3(-1.0, 2.0, -3.0));
+    vec3 lightDirection = normalize(lightDirections[0].xyz);
+    vec3 lightDirection2 = normalize(lightDirections[1].xyz);
     float ambient = 0.2;
     float diffuse = max(0.0, dot(normalize(normalFrag), lightDirection));
     diffuse += max(0.0, dot(normalize(normalFrag), lightDirection2));
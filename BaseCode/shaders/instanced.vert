@@ -0,0 +1,18 @@
+#version 330
+
+uniform mat4 projection, view;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec4 instancePosition;
+layout(location = 3) in vec4 instanceColor;
+out vec3 normalFrag;
+out vec4 colorFrag;
+
+void main()
+{
+  normalFrag = normal;
+  colorFrag = instanceColor;
+	// Offset the mesh to the instance position, and transform to clipping coordinates
+	gl_Position = projection * view * vec4(position + instancePosition.xyz, 1.0);
+}
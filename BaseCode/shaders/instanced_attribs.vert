@@ -0,0 +1,25 @@
+#version 330
+
+uniform mat4 projection, view;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec4 instanceTranslation;
+layout(location = 3) in vec4 instanceRotation;
+layout(location = 4) in vec4 instanceColor;
+out vec3 normalFrag;
+out vec4 colorFrag;
+
+// Rotate a vector by a unit quaternion (x, y, z, w)
+vec3 rotate(vec4 q, vec3 v)
+{
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+  normalFrag = rotate(instanceRotation, normal);
+  colorFrag = instanceColor;
+	// Place the mesh like the instance, and transform to clipping coordinates
+	gl_Position = projection * view * vec4(rotate(instanceRotation, position) + instanceTranslation.xyz, 1.0);
+}